@@ -0,0 +1,205 @@
+
+/*-------------------------------------------------------------*/
+/*--- Batch compression of many small buffers               ---*/
+/*---                                               batch.c ---*/
+/*-------------------------------------------------------------*/
+
+/* ------------------------------------------------------------------
+   This file is part of bzip2/libbzip2, a program and library for
+   lossless, block-sorting data compression.
+
+   bzip2/libbzip2 version 1.1.0 of 6 September 2010
+   Copyright (C) 1996-2010 Julian Seward <jseward@acm.org>
+
+   Please read the WARNING, DISCLAIMER and PATENTS sections in the
+   README file.
+
+   This program is released under the terms of the license contained
+   in the file COPYING.
+   ------------------------------------------------------------------ */
+
+/*--
+   Bei kleinen Puffern kostet BZ2_bzBuffToBuffCompress vor allem
+   das Anlegen und Freigeben des Kompressionszustands. Hier legt
+   jeder Arbeits-Thread genau einen Zustand an, passend zum
+   größten Eintrag, und setzt ihn zwischen zwei Einträgen nur mit
+   BZ2_bzCompressReset zurück. Die Threads holen sich den jeweils
+   nächsten Eintrag über einen gemeinsamen Zähler, so dass
+   unterschiedlich große Einträge sich von selbst verteilen.
+--*/
+
+#include "bzlib_private.h"
+
+
+typedef struct {
+  bz_batch_item* items;
+  Int32          nItems;
+  /* nächster freier Eintrag, atomar weitergezählt */
+  Int32          next;
+}
+BatchShared;
+
+typedef struct {
+  bzPoolTask   task;
+  BatchShared* shared;
+  bz_stream    strm;
+  /* strm ist initialisiert */
+  Bool         ready;
+}
+BatchWorker;
+
+
+/*---------------------------------------------------*/
+static void batch_compress_item ( BatchWorker* w, bz_batch_item* item ) {
+  bz_stream* strm = &w->strm;
+  int        r;
+
+  if (item->source == NULL || item->dest == NULL) {
+    item->status = BZ_PARAM_ERROR;
+    return;
+  }
+
+  strm->next_in   = item->source;
+  strm->avail_in  = item->sourceLen;
+  strm->next_out  = item->dest;
+  strm->avail_out = item->destLen;
+  r = BZ2_bzCompress ( strm, BZ_FINISH );
+  if (r == BZ_STREAM_END) {
+    item->destLen -= strm->avail_out;
+    item->status   = BZ_OK;
+  }
+  else if (r == BZ_FINISH_OK) {
+    item->status = BZ_OUTBUFF_FULL;
+  }
+  else {
+    item->status = r;
+  }
+  BZ2_bzCompressReset ( strm );
+}
+
+
+/*---------------------------------------------------*/
+static void batch_run ( void* arg ) {
+  BatchWorker* w = (BatchWorker*)arg;
+  BatchShared* b = w->shared;
+  Int32        i;
+
+  while (True) {
+    i = __atomic_fetch_add ( &b->next, 1, __ATOMIC_RELAXED );
+    if (i >= b->nItems) {
+      break;
+    }
+    batch_compress_item ( w, &b->items[i] );
+  }
+}
+
+
+/*---------------------------------------------------*/
+/**
+ * @brief Komprimiert viele Puffer unabhängig voneinander.
+ *
+ * Jeder Eintrag wird genau so komprimiert wie mit
+ * `BZ2_bzBuffToBuffCompress`; `destLen` und `status` werden pro
+ * Eintrag gesetzt. Bis zu `nThreads` Threads arbeiten parallel, jeder
+ * mit einem einzigen, wiederverwendeten Kompressionszustand. Mit
+ * `nThreads` 0 oder 1 läuft alles im aufrufenden Thread. Lässt sich
+ * nicht für jeden Thread ein Zustand anlegen, arbeiten entsprechend
+ * weniger Threads.
+ *
+ * @return `BZ_OK`, sobald alle Einträge bearbeitet sind (auch wenn
+ *         einzelne fehlschlagen), sonst `BZ_PARAM_ERROR` oder
+ *         `BZ_MEM_ERROR`, wenn kein einziger Zustand angelegt werden
+ *         konnte.
+ */
+int BZ2_bzBuffToBuffCompressBatch ( bz_batch_item* items, int nItems, int blockSize100k, int workFactor, int nThreads ) {
+  BatchShared  shared;
+  BatchWorker* workers;
+  bzPool*      pool = NULL;
+  Int32        nWorkers;
+  Int32        nReady = 0;
+  UInt32       maxLen = 1;
+
+  if (items == NULL || nItems < 0 || blockSize100k < 1 || blockSize100k > 9
+      || workFactor < 0 || workFactor > 250 || nThreads < 0 || nThreads > BZ_MAX_THREADS) {
+    return BZ_PARAM_ERROR;
+  }
+  if (nItems == 0) {
+    return BZ_OK;
+  }
+
+  for (Int32 i = 0; i < nItems; i++) {
+    if (items[i].sourceLen > maxLen) {
+      maxLen = items[i].sourceLen;
+    }
+  }
+  nWorkers = (nThreads < 1) ? 1 : nThreads;
+  if (nWorkers > nItems) {
+    nWorkers = nItems;
+  }
+
+  workers = malloc ( nWorkers * sizeof(BatchWorker) );
+  if (workers == NULL) {
+    return BZ_MEM_ERROR;
+  }
+  shared.items  = items;
+  shared.nItems = nItems;
+  shared.next   = 0;
+  for (Int32 i = 0; i < nWorkers; i++) {
+    BatchWorker* w = &workers[i];
+    w->task.run      = batch_run;
+    w->task.arg      = w;
+    w->shared        = &shared;
+    w->strm.bzalloc  = NULL;
+    w->strm.bzfree   = NULL;
+    w->strm.opaque   = NULL;
+    /* ein Zustand für alle Einträge: passend zum größten */
+    w->ready = (Bool)(BZ2_bzCompressInitSized ( &w->strm, blockSize100k, workFactor, maxLen ) == BZ_OK);
+    if (w->ready) {
+      nReady += 1;
+    }
+  }
+  if (nReady == 0) {
+    free ( workers );
+    return BZ_MEM_ERROR;
+  }
+
+  /* nur Arbeiter mit Zustand holen sich Einträge */
+  if (nReady > 1) {
+    pool = BZ2_poolCreate ( nReady );
+  }
+  if (pool != NULL) {
+    for (Int32 i = 0; i < nWorkers; i++) {
+      if (workers[i].ready) {
+        BZ2_poolSubmit ( pool, &workers[i].task );
+      }
+    }
+    for (Int32 i = 0; i < nWorkers; i++) {
+      if (workers[i].ready) {
+        BZ2_poolWait ( pool, &workers[i].task );
+      }
+    }
+    BZ2_poolDestroy ( pool );
+  }
+  else {
+    /* ohne Pool bearbeitet der erste bereite Zustand alles */
+    for (Int32 i = 0; i < nWorkers; i++) {
+      if (workers[i].ready) {
+        batch_run ( &workers[i] );
+        break;
+      }
+    }
+  }
+
+  for (Int32 i = 0; i < nWorkers; i++) {
+    if (workers[i].ready) {
+      BZ2_bzCompressEnd ( &workers[i].strm );
+    }
+  }
+  free ( workers );
+  return BZ_OK;
+}
+
+
+/*-------------------------------------------------------------*/
+/*--- end                                           batch.c ---*/
+/*-------------------------------------------------------------*/
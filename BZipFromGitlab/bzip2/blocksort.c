@@ -206,12 +206,139 @@ static void fallbackQSort3 ( UInt32* fmap, UInt32* eclass, Int32 loSt, Int32 hiS
 #undef FALLBACK_QSORT_STACK_SIZE
 
 
+/*---------------------------------------------*/
+/*--
+   Helpers for spreading work over s->sortPool.
+   runTasks runs the first task on the calling thread
+   and returns when all of them have finished.  The
+   initial radix passes of both sorts are split into
+   chunks of at least RADIX_PAR_CHUNK positions, one
+   per task; each task counts its chunk, the counts are
+   merged, and each task then scatters its chunk into its
+   own slice of every bucket.  The slices are laid out in
+   the order the sequential loop would have filled them,
+   so ptr / fmap come out exactly the same.
+--*/
+static const Int32 RADIX_PAR_CHUNK = 65536;
+
+static void runTasks ( bzPool* pool, bzPoolTask** tasks, Int32 nTasks ) {
+  Int32 i;
+  
+  for (i = 1; i < nTasks; i++) {
+    BZ2_poolSubmit ( pool, tasks[i] );
+  }
+  tasks[0]->run ( tasks[0]->arg );
+  for (i = 1; i < nTasks; i++) {
+    BZ2_poolWait ( pool, tasks[i] );
+  }
+}
+
+static Int32 radixTasks ( bzPool* pool, Int32 nblock ) {
+  Int32 n;
+  
+  if (pool == NULL) {
+    return 1;
+  }
+  n = BZ2_poolSize ( pool ) + 1;
+  if (n > BZ_SORT_HIST_MAX) {
+    n = BZ_SORT_HIST_MAX;
+  }
+  if (n > nblock / RADIX_PAR_CHUNK) {
+    n = nblock / RADIX_PAR_CHUNK;
+  }
+  return (n < 1) ? 1 : n;
+}
+
+
+/*---------------------------------------------*/
+typedef struct {
+  bzPoolTask task;
+  UChar*     eclass8;
+  UInt32*    fmap;
+  Int32      lo;
+  Int32      hi;
+  Int32      ftab[256];
+}
+FallbackRadixTask;
+
+static void fallbackRadixCount ( void* arg ) {
+  FallbackRadixTask* t = (FallbackRadixTask*)arg;
+  Int32              i;
+  
+  for (i = 0; i < 256; i++) {
+    t->ftab[i] = 0;
+  }
+  for (i = t->lo; i < t->hi; i++) {
+    t->ftab[t->eclass8[i]] += 1;
+  }
+}
+
+static void fallbackRadixScatter ( void* arg ) {
+  FallbackRadixTask* t = (FallbackRadixTask*)arg;
+  Int32              i, j, k;
+  
+  for (i = t->lo; i < t->hi; i++) {
+    j = t->eclass8[i];
+    k = t->ftab[j] - 1;
+    t->ftab[j] = k;
+    t->fmap[k] = i;
+  }
+}
+
+/*--
+   The sequential pass fills each bucket from the top
+   down in increasing i, so the first chunk owns the
+   top slice of every bucket.  Leaves ftab and ftabCopy
+   as the sequential pass does: bucket starts and sizes.
+--*/
+static void fallbackRadixParallel ( bzPool* pool, Int32 nTasks, UInt32* fmap, UChar* eclass8, Int32 nblock, Int32* ftab, Int32* ftabCopy ) {
+  FallbackRadixTask tasks[BZ_SORT_HIST_MAX];
+  bzPoolTask*       list [BZ_SORT_HIST_MAX];
+  Int32             i, t, c, start, end;
+  
+  for (t = 0; t < nTasks; t++) {
+    tasks[t].task.run = fallbackRadixCount;
+    tasks[t].task.arg = &tasks[t];
+    tasks[t].eclass8  = eclass8;
+    tasks[t].fmap     = fmap;
+    tasks[t].lo       = (Int32)(((UInt64)nblock * t)     / nTasks);
+    tasks[t].hi       = (Int32)(((UInt64)nblock * (t+1)) / nTasks);
+    list[t]           = &tasks[t].task;
+  }
+  runTasks ( pool, list, nTasks );
+  
+  start = 0;
+  for (i = 0; i < 256; i++) {
+    c = 0;
+    for (t = 0; t < nTasks; t++) {
+      c += tasks[t].ftab[i];
+    }
+    ftabCopy[i] = c;
+    ftab    [i] = start;
+    end = start + c;
+    for (t = 0; t < nTasks; t++) {
+      c = tasks[t].ftab[i];
+      tasks[t].ftab[i] = end;
+      end -= c;
+    }
+    start += ftabCopy[i];
+  }
+  ftab[256] = nblock;
+  
+  for (t = 0; t < nTasks; t++) {
+    tasks[t].task.run = fallbackRadixScatter;
+  }
+  runTasks ( pool, list, nTasks );
+}
+
+
 /*---------------------------------------------*/
 /* Pre:
       nblock > 0
       eclass exists for [0 .. nblock-1]
       ((UChar*)eclass) [0 .. nblock-1] holds block
       ptr exists for [0 .. nblock-1]
+      pool is NULL, or helpers for the initial radix sort
 
    Post:
       ((UChar*)eclass) [0 .. nblock-1] holds block
@@ -226,36 +353,43 @@ static void fallbackQSort3 ( UInt32* fmap, UInt32* eclass, Int32 loSt, Int32 hiS
 #define      WORD_BH(zz)  bhtab[(zz) >> 5]
 #define UNALIGNED_BH(zz)  ((zz) & 0x01f)
 
-static void fallbackSort ( UInt32* fmap, UInt32* eclass, UInt32* bhtab, Int32 nblock) {
+static void fallbackSort ( UInt32* fmap, UInt32* eclass, UInt32* bhtab, Int32 nblock, bzPool* pool ) {
   Int32 ftab[257];
   Int32 ftabCopy[256];
   Int32 H, i, j, k, l, r, cc, cc1;
   Int32 nNotDone;
   Int32 nBhtab;
+  Int32 nTasks;
   UChar* eclass8 = (UChar*)eclass;
   
   /*--
    Initial 1-char radix sort to generate
    initial fmap and initial BH bits.
    --*/
-  for (i = 0; i < 257;    i++) {
-    ftab[i] = 0;
-  }
-  for (i = 0; i < nblock; i++) {
-    ftab[eclass8[i]] += 1;
+  nTasks = radixTasks ( pool, nblock );
+  if (nTasks > 1) {
+    fallbackRadixParallel ( pool, nTasks, fmap, eclass8, nblock, ftab, ftabCopy );
   }
-  for (i = 0; i < 256;    i++) {
-    ftabCopy[i] = ftab[i];
-  }
-  for (i = 1; i < 257;    i++) {
-    ftab[i] += ftab[i-1];
-  }
-  
-  for (i = 0; i < nblock; i++) {
-    j = eclass8[i];
-    k = ftab[j] - 1;
-    ftab[j] = k;
-    fmap[k] = i;
+  else {
+    for (i = 0; i < 257;    i++) {
+      ftab[i] = 0;
+    }
+    for (i = 0; i < nblock; i++) {
+      ftab[eclass8[i]] += 1;
+    }
+    for (i = 0; i < 256;    i++) {
+      ftabCopy[i] = ftab[i];
+    }
+    for (i = 1; i < 257;    i++) {
+      ftab[i] += ftab[i-1];
+    }
+    
+    for (i = 0; i < nblock; i++) {
+      j = eclass8[i];
+      k = ftab[j] - 1;
+      ftab[j] = k;
+      fmap[k] = i;
+    }
   }
   
   nBhtab = 2 + (nblock / 32);
@@ -383,41 +517,162 @@ static void fallbackSort ( UInt32* fmap, UInt32* eclass, UInt32* bhtab, Int32 nb
 /*---------------------------------------------*/
 
 /*---------------------------------------------*/
-static inline Bool mainGtU ( UInt32 i1, UInt32 i2, UChar* block, UInt16* quadrant, UInt32 nblock, Int32* budget ) {
-  Int32 k;
-  UChar c1, c2;
-  UInt16 s1, s2;
+/*--
+   Block and quadrant come in two layouts.  Split
+   (BZ_LAYOUT_SPLIT) is the classic one: the bytes,
+   then a separate UInt16 array.  Packed
+   (BZ_LAYOUT_PACKED) gives every position one UInt32
+   record, block[i] << 24 | quadrant[i], so the byte
+   and quadrant entry mainGtU compares together share a
+   cache line, and one chunk of 8 positions is 32
+   contiguous bytes instead of 8 + 16 bytes in two
+   distant places.  The sorting code sees both through
+   the same two pointers, indexed as block[i << bsh]
+   and quadrant[i << (bsh >> 1)]: bsh is 0 for split
+   and 2 for packed, with block and quadrant pointing
+   at the byte and the low half of record 0.
+   
+   The records fill arr2 exactly (4 bytes for each of
+   nblock + BZ_N_OVERSHOOT positions), so packBlock
+   widens the bytes in place, from the top down, and
+   unpackBlock narrows them again before MTF sees the
+   block.
+--*/
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define PACK_BYTE 0
+#define PACK_QUAD 1
+#else
+#define PACK_BYTE 3
+#define PACK_QUAD 0
+#endif
+
+static void packBlock ( UChar* block, Int32 nblock ) {
+  UInt32* rec = (UInt32*)block;
+  Int32   i;
+  
+  for (i = nblock + BZ_N_OVERSHOOT - 1; i >= 0; i--) {
+    rec[i] = (UInt32)block[i] << 24;
+  }
+}
+
+static void unpackBlock ( UChar* block, Int32 nblock ) {
+  UInt32* rec = (UInt32*)block;
+  Int32   i;
   
-  // Gemini schafte diesen loop-enroll halbwegs rückgängig zu machen
-  for (int i = 0; i < 12; ++i) {
-    c1 = block[i1++];
-    c2 = block[i2++];
-    if (c1 != c2) {
-      return (c1 > c2);
+  for (i = 0; i < nblock; i++) {
+    block[i] = (UChar)(rec[i] >> 24);
+  }
+}
+
+/*--
+   mainGtU on packed records.  Same comparisons and
+   budget as below: the first 12 bytes alone, then
+   whole records, which order by byte and then by
+   quadrant entry.
+--*/
+static Bool mainGtUPacked ( UInt32 i1, UInt32 i2, UInt32* rec, UInt32 nblock, Int32* budget ) {
+  Int32  j, k;
+  UInt64 w1, w2;
+  UInt32 r1, r2;
+  
+  /*-- two records per load, comparing just their bytes --*/
+  for (j = 0; j < 12; j += 2) {
+    memcpy ( &w1, &rec[i1+j], 8 );
+    memcpy ( &w2, &rec[i2+j], 8 );
+    if (((w1 ^ w2) & 0xFF000000FF000000ull) != 0) {
+      r1 = rec[i1+j] >> 24;
+      r2 = rec[i2+j] >> 24;
+      if (r1 == r2) {
+        r1 = rec[i1+j+1] >> 24;
+        r2 = rec[i2+j+1] >> 24;
+      }
+      return (r1 > r2);
     }
   }
+  i1 += 12;
+  i2 += 12;
   
   k = nblock + 8;
   
-  // hier scheiterte Gemini aber DeepSeek konnte es im zweiten Anlauf machen - und genau deshalb ist moderne Programmierung TDD
   do {
-    for (int chunk = 0; chunk < 8; chunk++) {
-      c1 = block[i1];
-      c2 = block[i2];
-      if (c1 != c2) {
-        return (c1 > c2);
+    if (memcmp ( &rec[i1], &rec[i2], 8 * sizeof(UInt32) ) != 0) {
+      for (j = 0; j < 8; j++) {
+        if (rec[i1+j] != rec[i2+j]) {
+          return (rec[i1+j] > rec[i2+j]);
+        }
       }
-      
-      s1 = quadrant[i1];
-      s2 = quadrant[i2];
-      if (s1 != s2) {
-        return (s1 > s2);
+    }
+    
+    i1 += 8;
+    i2 += 8;
+    if (i1 >= nblock) {
+      i1 -= nblock;
+    }
+    if (i2 >= nblock) {
+      i2 -= nblock;
+    }
+    
+    k -= 8;
+    (*budget) -= 1;
+  } while (k >= 0);
+  
+  return False;
+}
+
+/*---------------------------------------------*/
+/*--
+   Compares the rotations at i1 and i2 exactly as the
+   byte-wise loop did: 12 plain bytes first, then
+   chunks of 8 positions, each position comparing the
+   byte and then its quadrant entry, one budget unit per
+   chunk.  Bytes are compared 8 (then 4) at a time as
+   big-endian words, so the word order is the byte
+   order and the first differing byte is found with
+   clz.  A chunk whose bytes and quadrant entries all
+   match is skipped without looking at single entries.
+   The loads stay within the BZ_N_OVERSHOOT copy behind
+   the block, as the byte-wise reads did.
+--*/
+static inline Bool mainGtU ( UInt32 i1, UInt32 i2, UChar* block, UInt16* quadrant, UInt32 nblock, Int32 bsh, Int32* budget ) {
+  Int32  k;
+  UInt64 w1, w2;
+  UInt32 v1, v2;
+  Int32  p;
+  
+  if (bsh != 0) {
+    return mainGtUPacked ( i1, i2, (UInt32*)(block - PACK_BYTE), nblock, budget );
+  }
+  w1 = loadBE64 ( &block[i1] );
+  w2 = loadBE64 ( &block[i2] );
+  if (w1 != w2) {
+    return (w1 > w2);
+  }
+  v1 = loadBE32 ( &block[i1+8] );
+  v2 = loadBE32 ( &block[i2+8] );
+  if (v1 != v2) {
+    return (v1 > v2);
+  }
+  i1 += 12;
+  i2 += 12;
+  
+  k = nblock + 8;
+  
+  do {
+    w1 = loadBE64 ( &block[i1] );
+    w2 = loadBE64 ( &block[i2] );
+    if (w1 != w2 || memcmp ( &quadrant[i1], &quadrant[i2], 8 * sizeof(UInt16) ) != 0) {
+      /* bytes agree before position p; quadrants are checked up to it */
+      p = (w1 != w2) ? (__builtin_clzll ( w1 ^ w2 ) >> 3) : 8;
+      for (Int32 j = 0; j < p; j++) {
+        if (quadrant[i1+j] != quadrant[i2+j]) {
+          return (quadrant[i1+j] > quadrant[i2+j]);
+        }
       }
-      
-      i1 += 1;
-      i2 += 1;
+      return (block[i1+p] > block[i2+p]);
     }
     
+    i1 += 8;
+    i2 += 8;
     if (i1 >= nblock) {
       i1 -= nblock;
     }
@@ -442,7 +697,7 @@ static inline Bool mainGtU ( UInt32 i1, UInt32 i2, UChar* block, UInt16* quadran
 --*/
 static const Int32 incs[14] = { 1, 4, 13, 40, 121, 364, 1093, 3280, 9841, 29524, 88573, 265720, 797161, 2391484 };
 
-static void mainSimpleSort ( UInt32* ptr, UChar* block, UInt16* quadrant, Int32 nblock, Int32 lo, Int32 hi, Int32 d, Int32* budget ) {
+static void mainSimpleSort ( UInt32* ptr, UChar* block, UInt16* quadrant, Int32 nblock, Int32 bsh, Int32 lo, Int32 hi, Int32 d, Int32* budget ) {
   Int32 i, j, h, bigN, hp;
   UInt32 v;
   
@@ -469,7 +724,7 @@ static void mainSimpleSort ( UInt32* ptr, UChar* block, UInt16* quadrant, Int32
       }
       v = ptr[i];
       j = i;
-      while ( mainGtU (ptr[j-h]+d, v+d, block, quadrant, nblock, budget) ) {
+      while ( mainGtU (ptr[j-h]+d, v+d, block, quadrant, nblock, bsh, budget) ) {
         ptr[j] = ptr[j-h];
         j = j - h;
         if (j <= (lo + h - 1)) {
@@ -483,7 +738,7 @@ static void mainSimpleSort ( UInt32* ptr, UChar* block, UInt16* quadrant, Int32
       if (i > hi) break;
       v = ptr[i];
       j = i;
-      while ( mainGtU (ptr[j-h]+d, v+d, block, quadrant, nblock, budget) ) {
+      while ( mainGtU (ptr[j-h]+d, v+d, block, quadrant, nblock, bsh, budget) ) {
         ptr[j] = ptr[j-h];
         j = j - h;
         if (j <= (lo + h - 1)) {
@@ -497,7 +752,7 @@ static void mainSimpleSort ( UInt32* ptr, UChar* block, UInt16* quadrant, Int32
       if (i > hi) break;
       v = ptr[i];
       j = i;
-      while ( mainGtU (ptr[j-h]+d, v+d, block, quadrant, nblock, budget ) ) {
+      while ( mainGtU (ptr[j-h]+d, v+d, block, quadrant, nblock, bsh, budget ) ) {
         ptr[j] = ptr[j-h];
         j = j - h;
         if (j <= (lo + h - 1)) {
@@ -571,9 +826,17 @@ static inline UChar mmed3 ( UChar a, UChar b, UChar c ) {
 #define MAIN_QSORT_DEPTH_THRESH (BZ_N_RADIX + BZ_N_QSORT)
 #define MAIN_QSORT_STACK_SIZE 100
 
-static void mainQSort3 ( UInt32* ptr, UChar* block, UInt16* quadrant, Int32 nblock, Int32 loSt, Int32 hiSt, Int32 dSt, Int32* budget ) {
+/*--
+   If shared is not NULL, several threads sort at once
+   and shared holds the budget they have left in common.
+   What mainSimpleSort used is charged to it after every
+   call, and *budget is reloaded from it, so each thread
+   sees the others' cost and stops once the sum exceeds
+   the budget.
+--*/
+static void mainQSort3 ( UInt32* ptr, UChar* block, UInt16* quadrant, Int32 nblock, Int32 bsh, Int32 loSt, Int32 hiSt, Int32 dSt, Int32* budget, Int32* shared ) {
   Int32 unLo, unHi, ltLo, gtHi, n, m, med;
-  Int32 sp, lo, hi, d;
+  Int32 sp, lo, hi, d, before;
   
   Int32 stackLo[MAIN_QSORT_STACK_SIZE];
   Int32 stackHi[MAIN_QSORT_STACK_SIZE];
@@ -590,7 +853,11 @@ static void mainQSort3 ( UInt32* ptr, UChar* block, UInt16* quadrant, Int32 nblo
     
     mpop ( lo, hi, d );
     if (hi - lo < MAIN_QSORT_SMALL_THRESH || d > MAIN_QSORT_DEPTH_THRESH) {
-      mainSimpleSort ( ptr, block, quadrant, nblock, lo, hi, d, budget );
+      before = *budget;
+      mainSimpleSort ( ptr, block, quadrant, nblock, bsh, lo, hi, d, budget );
+      if (shared != NULL) {
+        *budget = __atomic_sub_fetch ( shared, before - *budget, __ATOMIC_RELAXED );
+      }
       if (*budget < 0) {
         return;
       }
@@ -598,9 +865,9 @@ static void mainQSort3 ( UInt32* ptr, UChar* block, UInt16* quadrant, Int32 nblo
     }
     
     med = (Int32)
-    mmed3 ( block[ptr[ lo         ]+d],
-           block[ptr[ hi         ]+d],
-           block[ptr[ (lo+hi)>>1 ]+d] );
+    mmed3 ( block[(ptr[ lo         ]+d) << bsh],
+           block[(ptr[ hi         ]+d) << bsh],
+           block[(ptr[ (lo+hi)>>1 ]+d) << bsh] );
     
     unLo = ltLo = lo;
     unHi = gtHi = hi;
@@ -608,7 +875,7 @@ static void mainQSort3 ( UInt32* ptr, UChar* block, UInt16* quadrant, Int32 nblo
     while (True) {
       while (True) {
         if (unLo > unHi) break;
-        n = ((Int32)block[ptr[unLo]+d]) - med;
+        n = ((Int32)block[(ptr[unLo]+d) << bsh]) - med;
         if (n == 0) {
           mswap(ptr[unLo], ptr[ltLo]);
           ltLo += 1;
@@ -622,7 +889,7 @@ static void mainQSort3 ( UInt32* ptr, UChar* block, UInt16* quadrant, Int32 nblo
       }
       while (True) {
         if (unLo > unHi) break;
-        n = ((Int32)block[ptr[unHi]+d]) - med;
+        n = ((Int32)block[(ptr[unHi]+d) << bsh]) - med;
         if (n == 0) {
           mswap(ptr[unHi], ptr[gtHi]);
           gtHi -= 1;
@@ -688,12 +955,180 @@ static void mainQSort3 ( UInt32* ptr, UChar* block, UInt16* quadrant, Int32 nblo
 #undef MAIN_QSORT_STACK_SIZE
 
 
+/*---------------------------------------------*/
+/*--
+   Step 1 of mainSort on several threads.  The small
+   buckets [ss, j] of one big bucket occupy disjoint
+   ranges of ptr, and sorting them only reads block and
+   quadrant (quadrant is not written until Step 3), so
+   they can be sorted concurrently with identical
+   results.  Each task takes ranges from a shared counter
+   and charges one shared budget; since no range ever
+   gives budget back, the summed cost exceeds the budget
+   exactly when the sequential loop would have given up,
+   so the choice of algorithm is unchanged too, and all
+   tasks stop soon after that point.
+   Below MAIN_PAR_MIN unsorted entries per big bucket the
+   hand-off costs more than it saves.
+--*/
+static const Int32 MAIN_PAR_MIN = 16384;
+
+typedef struct {
+  bzPoolTask task;
+  UInt32*    ptr;
+  UChar*     block;
+  UInt16*    quadrant;
+  Int32      nblock;
+  Int32      bsh;
+  Int32      (*ranges)[2];
+  Int32      nRanges;
+  Int32*     next;
+  Int32*     budget;
+}
+SortTask;
+
+static void sortTaskRun ( void* arg ) {
+  SortTask* t = (SortTask*)arg;
+  Int32     r, budget;
+  
+  while ((budget = __atomic_load_n ( t->budget, __ATOMIC_RELAXED )) >= 0) {
+    r = __atomic_fetch_add ( t->next, 1, __ATOMIC_RELAXED );
+    if (r >= t->nRanges) {
+      break;
+    }
+    mainQSort3 ( t->ptr, t->block, t->quadrant, t->nblock, t->bsh, t->ranges[r][0], t->ranges[r][1], BZ_N_RADIX, &budget, t->budget );
+  }
+}
+
+static void mainQSortParallel ( bzPool* pool, UInt32* ptr, UChar* block, UInt16* quadrant, Int32 nblock, Int32 bsh, Int32 (*ranges)[2], Int32 nRanges, Int32* budget ) {
+  SortTask    tasks[BZ_MAX_THREADS];
+  bzPoolTask* list [BZ_MAX_THREADS];
+  Int32       nTasks = BZ2_poolSize ( pool ) + 1;
+  Int32       next   = 0;
+  Int32       i;
+  
+  if (nTasks > nRanges) {
+    nTasks = nRanges;
+  }
+  for (i = 0; i < nTasks; i++) {
+    tasks[i].task.run = sortTaskRun;
+    tasks[i].task.arg = &tasks[i];
+    tasks[i].ptr      = ptr;
+    tasks[i].block    = block;
+    tasks[i].quadrant = quadrant;
+    tasks[i].nblock   = nblock;
+    tasks[i].bsh      = bsh;
+    tasks[i].ranges   = ranges;
+    tasks[i].nRanges  = nRanges;
+    tasks[i].next     = &next;
+    tasks[i].budget   = budget;
+    list[i]           = &tasks[i].task;
+  }
+  runTasks ( pool, list, nTasks );
+}
+
+
+/*---------------------------------------------*/
+/*--
+   The initial radix sort of mainSort, split over
+   nTasks chunks.  Each task has 65536 counters in hist;
+   the sequential pass fills each small bucket upwards in
+   increasing position, so the first chunk owns the
+   bottom slice of every bucket.  Runs after block has
+   been extended by the overshoot, so the 2-byte key of
+   the last position needs no wrap-around.
+--*/
+typedef struct {
+  bzPoolTask task;
+  UInt32*    ptr;
+  UChar*     block;
+  UInt16*    quadrant;
+  UInt32*    ftab;
+  Int32      lo;
+  Int32      hi;
+}
+MainRadixTask;
+
+static void mainRadixCount ( void* arg ) {
+  MainRadixTask* t     = (MainRadixTask*)arg;
+  UChar*         block = t->block;
+  UInt32*        ftab  = t->ftab;
+  Int32          i;
+  UInt16         s;
+  
+  for (i = 0; i < 65536; i++) {
+    ftab[i] = 0;
+  }
+  s = block[t->hi] << 8;
+  for (i = t->hi - 1; i >= t->lo; i--) {
+    t->quadrant[i] = 0;
+    s = (s >> 8) | (block[i] << 8);
+    ftab[s] += 1;
+  }
+}
+
+static void mainRadixScatter ( void* arg ) {
+  MainRadixTask* t     = (MainRadixTask*)arg;
+  UChar*         block = t->block;
+  UInt32*        ftab  = t->ftab;
+  Int32          i, j;
+  UInt16         s;
+  
+  s = block[t->hi] << 8;
+  for (i = t->hi - 1; i >= t->lo; i--) {
+    s = (s >> 8) | (block[i] << 8);
+    j = ftab[s] - 1;
+    ftab[s] = j;
+    t->ptr[j] = i;
+  }
+}
+
+static void mainRadixParallel ( bzPool* pool, Int32 nTasks, UInt32* ptr, UChar* block, UInt16* quadrant, UInt32* ftab, UInt32* hist, Int32 nblock ) {
+  MainRadixTask tasks[BZ_SORT_HIST_MAX];
+  bzPoolTask*   list [BZ_SORT_HIST_MAX];
+  Int32         i, t;
+  UInt32        end;
+  
+  for (t = 0; t < nTasks; t++) {
+    tasks[t].task.run = mainRadixCount;
+    tasks[t].task.arg = &tasks[t];
+    tasks[t].ptr      = ptr;
+    tasks[t].block    = block;
+    tasks[t].quadrant = quadrant;
+    tasks[t].ftab     = hist + t * 65536;
+    tasks[t].lo       = (Int32)(((UInt64)nblock * t)     / nTasks);
+    tasks[t].hi       = (Int32)(((UInt64)nblock * (t+1)) / nTasks);
+    list[t]           = &tasks[t].task;
+  }
+  runTasks ( pool, list, nTasks );
+  
+  end = 0;
+  for (i = 0; i < 65536; i++) {
+    ftab[i] = end;
+    for (t = 0; t < nTasks; t++) {
+      end += tasks[t].ftab[i];
+      tasks[t].ftab[i] = end;
+    }
+  }
+  ftab[65536] = end;
+  
+  for (t = 0; t < nTasks; t++) {
+    tasks[t].task.run = mainRadixScatter;
+  }
+  runTasks ( pool, list, nTasks );
+}
+
+
 /*---------------------------------------------*/
 /* Pre:
       nblock > N_OVERSHOOT
       block32 exists for [0 .. nblock-1 +N_OVERSHOOT]
       ((UChar*)block32) [0 .. nblock-1] holds block
       ptr exists for [0 .. nblock-1]
+      pool is NULL, or helpers for Step 1
+      hist is NULL, or 65536 counters per radix task
+      if packed, arr2 holds 4 * (nblock + N_OVERSHOOT)
+      bytes from block on
 
    Post:
       ((UChar*)block32) [0 .. nblock-1] holds block
@@ -701,83 +1136,110 @@ static void mainQSort3 ( UInt32* ptr, UChar* block, UInt16* quadrant, Int32 nblo
       ftab [0 .. 65536 ] destroyed
       ptr [0 .. nblock-1] holds sorted order
       if (*budget < 0), sorting was abandoned
+      if packed, block holds packed records; see
+      unpackBlock
 */
 
 #define BIGFREQ(b) (ftab[((b)+1) << 8] - ftab[(b) << 8])
 
-static void mainSort ( UInt32* ptr, UChar* block, UInt16* quadrant, UInt32* ftab, Int32 nblock, Int32* budget ) {
+static void mainSort ( UInt32* ptr, UChar* block, UInt16* quadrant, UInt32* ftab, Int32 nblock, Int32* budget, bzPool* pool, UInt32* hist, Bool packed ) {
   Int32  i, j, k, ss, sb;
   Int32  runningOrder[256];
+  Int32  ranges[256][2];
+  Int32  nRanges, nUnsorted;
   Bool   bigDone[256];
   Int32  copyStart[256];
   Int32  copyEnd  [256];
   UChar  c1;
   Int32  numQSorted;
   UInt16 s;
+  Int32  nTasks;
+  Int32  bsh = 0;
+  Int32  qsh = 0;
   
-  /*-- set up the 2-byte frequency table --*/
-  for (i = 65536; i >= 0; i--) {
-    ftab[i] = 0;
-  }
-  
-  j = block[0] << 8;
-  i = nblock-1;
-  for (; i >= 3; i -= 4) {
-    quadrant[i] = 0;
-    j = (j >> 8) | ( ((UInt16)block[i]) << 8);
-    ftab[j] += 1;
-    quadrant[i-1] = 0;
-    j = (j >> 8) | ( ((UInt16)block[i-1]) << 8);
-    ftab[j] += 1;
-    quadrant[i-2] = 0;
-    j = (j >> 8) | ( ((UInt16)block[i-2]) << 8);
-    ftab[j] += 1;
-    quadrant[i-3] = 0;
-    j = (j >> 8) | ( ((UInt16)block[i-3]) << 8);
-    ftab[j] += 1;
-  }
-  for (; i >= 0; i--) {
-    quadrant[i] = 0;
-    j = (j >> 8) | ( ((UInt16)block[i]) << 8);
-    ftab[j] += 1;
+  /*-- initial radix sort, on the pool for big blocks --*/
+  nTasks = (hist == NULL) ? 1 : radixTasks ( pool, nblock );
+  if (nTasks > 1) {
+    for (i = 0; i < BZ_N_OVERSHOOT; i++) {
+      block   [nblock+i] = block[i];
+      quadrant[nblock+i] = 0;
+    }
+    mainRadixParallel ( pool, nTasks, ptr, block, quadrant, ftab, hist, nblock );
   }
-  
-  /*-- (emphasises close relationship of block & quadrant) --*/
-  for (i = 0; i < BZ_N_OVERSHOOT; i++) {
-    block   [nblock+i] = block[i];
-    quadrant[nblock+i] = 0;
+  else {
+    /*-- set up the 2-byte frequency table --*/
+    for (i = 65536; i >= 0; i--) {
+      ftab[i] = 0;
+    }
+    
+    j = block[0] << 8;
+    i = nblock-1;
+    for (; i >= 3; i -= 4) {
+      quadrant[i] = 0;
+      j = (j >> 8) | ( ((UInt16)block[i]) << 8);
+      ftab[j] += 1;
+      quadrant[i-1] = 0;
+      j = (j >> 8) | ( ((UInt16)block[i-1]) << 8);
+      ftab[j] += 1;
+      quadrant[i-2] = 0;
+      j = (j >> 8) | ( ((UInt16)block[i-2]) << 8);
+      ftab[j] += 1;
+      quadrant[i-3] = 0;
+      j = (j >> 8) | ( ((UInt16)block[i-3]) << 8);
+      ftab[j] += 1;
+    }
+    for (; i >= 0; i--) {
+      quadrant[i] = 0;
+      j = (j >> 8) | ( ((UInt16)block[i]) << 8);
+      ftab[j] += 1;
+    }
+    
+    /*-- (emphasises close relationship of block & quadrant) --*/
+    for (i = 0; i < BZ_N_OVERSHOOT; i++) {
+      block   [nblock+i] = block[i];
+      quadrant[nblock+i] = 0;
+    }
+    
+    /*-- Complete the initial radix sort --*/
+    for (i = 1; i <= 65536; i++) {
+      ftab[i] += ftab[i-1];
+    }
+    
+    s = block[0] << 8;
+    i = nblock-1;
+    for (; i >= 3; i -= 4) {
+      s = (s >> 8) | (block[i] << 8);
+      j = ftab[s] -1;
+      ftab[s] = j;
+      ptr[j] = i;
+      s = (s >> 8) | (block[i-1] << 8);
+      j = ftab[s] -1;
+      ftab[s] = j;
+      ptr[j] = i-1;
+      s = (s >> 8) | (block[i-2] << 8);
+      j = ftab[s] -1;
+      ftab[s] = j;
+      ptr[j] = i-2;
+      s = (s >> 8) | (block[i-3] << 8);
+      j = ftab[s] -1;
+      ftab[s] = j;
+      ptr[j] = i-3;
+    }
+    for (; i >= 0; i--) {
+      s = (s >> 8) | (block[i] << 8);
+      j = ftab[s] -1;
+      ftab[s] = j;
+      ptr[j] = i;
+    }
   }
   
-  /*-- Complete the initial radix sort --*/
-  for (i = 1; i <= 65536; i++) {
-    ftab[i] += ftab[i-1];
-  }
-  
-  s = block[0] << 8;
-  i = nblock-1;
-  for (; i >= 3; i -= 4) {
-    s = (s >> 8) | (block[i] << 8);
-    j = ftab[s] -1;
-    ftab[s] = j;
-    ptr[j] = i;
-    s = (s >> 8) | (block[i-1] << 8);
-    j = ftab[s] -1;
-    ftab[s] = j;
-    ptr[j] = i-1;
-    s = (s >> 8) | (block[i-2] << 8);
-    j = ftab[s] -1;
-    ftab[s] = j;
-    ptr[j] = i-2;
-    s = (s >> 8) | (block[i-3] << 8);
-    j = ftab[s] -1;
-    ftab[s] = j;
-    ptr[j] = i-3;
-  }
-  for (; i >= 0; i--) {
-    s = (s >> 8) | (block[i] << 8);
-    j = ftab[s] -1;
-    ftab[s] = j;
-    ptr[j] = i;
+  /*-- from here on, block and quadrant may be packed --*/
+  if (packed) {
+    packBlock ( block, nblock );
+    quadrant = (UInt16*)block + PACK_QUAD;
+    block    = block + PACK_BYTE;
+    bsh      = 2;
+    qsh      = 1;
   }
   
   /*--
@@ -839,6 +1301,8 @@ static void mainSort ( UInt32* ptr, UChar* block, UInt16* quadrant, UInt32* ftab
      completed many of the small buckets [ss, j], so
      we don't have to sort them at all.
      --*/
+    nRanges   = 0;
+    nUnsorted = 0;
     for (j = 0; j <= 255; j++) {
       if (j != ss) {
         sb = (ss << 8) + j;
@@ -846,16 +1310,30 @@ static void mainSort ( UInt32* ptr, UChar* block, UInt16* quadrant, UInt32* ftab
           Int32 lo = ftab[sb]   & (~(1 << 21));
           Int32 hi = (ftab[sb+1] & (~(1 << 21))) - 1;
           if (hi > lo) {
-            mainQSort3 ( ptr, block, quadrant, nblock, lo, hi, BZ_N_RADIX, budget );
-            numQSorted += (hi - lo + 1);
-            if (*budget < 0) {
-              return;
-            }
+            ranges[nRanges][0] = lo;
+            ranges[nRanges][1] = hi;
+            nRanges   += 1;
+            nUnsorted += (hi - lo + 1);
           }
         }
         ftab[sb] |= (1 << 21);
       }
     }
+    if (pool != NULL && nRanges > 1 && nUnsorted >= MAIN_PAR_MIN) {
+      mainQSortParallel ( pool, ptr, block, quadrant, nblock, bsh, ranges, nRanges, budget );
+      if (*budget < 0) {
+        return;
+      }
+    }
+    else {
+      for (j = 0; j < nRanges; j++) {
+        mainQSort3 ( ptr, block, quadrant, nblock, bsh, ranges[j][0], ranges[j][1], BZ_N_RADIX, budget, NULL );
+        if (*budget < 0) {
+          return;
+        }
+      }
+    }
+    numQSorted += nUnsorted;
     
     /*--
      Step 2:
@@ -874,7 +1352,7 @@ static void mainSort ( UInt32* ptr, UChar* block, UInt16* quadrant, UInt32* ftab
         if (k < 0) {
           k += nblock;
         }
-        c1 = block[k];
+        c1 = block[k << bsh];
         if (!bigDone[c1]) {
           ptr[ copyStart[c1]++ ] = k;
         }
@@ -884,7 +1362,7 @@ static void mainSort ( UInt32* ptr, UChar* block, UInt16* quadrant, UInt32* ftab
         if (k < 0) {
           k += nblock;
         }
-        c1 = block[k];
+        c1 = block[k << bsh];
         if (!bigDone[c1]) {
           ptr[ copyEnd[c1]-- ] = k;
         }
@@ -948,9 +1426,9 @@ static void mainSort ( UInt32* ptr, UChar* block, UInt16* quadrant, UInt32* ftab
       for (j = bbSize-1; j >= 0; j--) {
         Int32 a2update     = ptr[bbStart + j];
         UInt16 qVal        = (UInt16)(j >> shifts);
-        quadrant[a2update] = qVal;
+        quadrant[a2update << qsh] = qVal;
         if (a2update < BZ_N_OVERSHOOT) {
-          quadrant[a2update + nblock] = qVal;
+          quadrant[(a2update + nblock) << qsh] = qVal;
         }
       }
     }
@@ -959,6 +1437,425 @@ static void mainSort ( UInt32* ptr, UChar* block, UInt16* quadrant, UInt32* ftab
 }
 
 #undef BIGFREQ
+#undef PACK_BYTE
+#undef PACK_QUAD
+
+
+/*---------------------------------------------*/
+/*--- Linear-time induced sorting (SA-IS),  ---*/
+/*--- for a predictable time per block      ---*/
+/*---------------------------------------------*/
+
+/*--
+   The BWT needs the sorted order of the cyclic
+   rotations of the block.  If the block is
+   primitive (not a power w^k of a shorter
+   string), all rotations are distinct and the
+   order is unique, so any correct sort yields
+   the same ptr[] and origPtr as mainSort.
+   Rotating such a block to its least rotation
+   makes it a Lyndon word, and for a Lyndon
+   word the suffix order (a proper prefix sorts
+   first) equals the rotation order.  So we
+   rotate, build the suffix array with SA-IS,
+   rotate back and remap the indices.
+
+   Periodic blocks have equal rotations whose
+   relative order is an artefact of the sort
+   used; those are left to fallbackSort so the
+   output keeps matching the other sorters.
+--*/
+
+#define SAIS_TGET(zz)  ((t[(zz) >> 5] >> ((zz) & 31)) & 1)
+#define SAIS_TSET(zz)  t[(zz) >> 5] |= ((UInt32)1 << ((zz) & 31))
+#define SAIS_CHR(zz)   (cs == 1 ? (Int32)((const UChar*)s)[zz] : ((const Int32*)s)[zz])
+#define SAIS_ISLMS(zz) ((zz) > 0 && SAIS_TGET(zz) && !SAIS_TGET((zz)-1))
+
+
+/*---------------------------------------------*/
+/*--
+   Classifies each position as S (bit set) or
+   L.  The virtual sentinel after s[n-1] is
+   smaller than every symbol, so s[n-1] is L.
+--*/
+static void saisClassify ( const void* s, Int32 cs, Int32 n, UInt32* t ) {
+  Int32 i;
+
+  for (i = 0; i <= (n >> 5); i++) {
+    t[i] = 0;
+  }
+  for (i = n-2; i >= 0; i--) {
+    Int32 c0 = SAIS_CHR(i);
+    Int32 c1 = SAIS_CHR(i+1);
+    if (c0 < c1 || (c0 == c1 && SAIS_TGET(i+1))) {
+      SAIS_TSET(i);
+    }
+  }
+}
+
+
+/*---------------------------------------------*/
+static void saisBuckets ( const void* s, Int32 cs, Int32 n, Int32* bkt, Int32 k, Bool end ) {
+  Int32 i;
+  Int32 sum = 0;
+
+  for (i = 0; i < k; i++) {
+    bkt[i] = 0;
+  }
+  for (i = 0; i < n; i++) {
+    bkt[SAIS_CHR(i)]++;
+  }
+  for (i = 0; i < k; i++) {
+    sum += bkt[i];
+    bkt[i] = end ? sum : sum - bkt[i];
+  }
+}
+
+
+/*---------------------------------------------*/
+static void saisInduce ( const void* s, Int32 cs, Int32* sa, Int32 n, const UInt32* t, Int32* bkt, Int32 k ) {
+  Int32 i;
+  Int32 j;
+
+  /*-- L-type suffixes, left to right, starting
+       with the one in front of the sentinel. --*/
+  saisBuckets ( s, cs, n, bkt, k, False );
+  j = n-1;
+  sa[bkt[SAIS_CHR(j)]++] = j;
+  for (i = 0; i < n; i++) {
+    j = sa[i] - 1;
+    if (j >= 0 && !SAIS_TGET(j)) {
+      sa[bkt[SAIS_CHR(j)]++] = j;
+    }
+  }
+
+  /*-- S-type suffixes, right to left. --*/
+  saisBuckets ( s, cs, n, bkt, k, True );
+  for (i = n-1; i >= 0; i--) {
+    j = sa[i] - 1;
+    if (j >= 0 && SAIS_TGET(j)) {
+      sa[--bkt[SAIS_CHR(j)]] = j;
+    }
+  }
+}
+
+
+/*---------------------------------------------*/
+/* Pre:
+      n > 0, symbols of s in [0 .. k-1]
+      cs == 1: s is UChar[], else Int32[]
+      t has room for n bits
+      bkt has room for k entries
+      bktRec has room for n/2 entries
+
+   Post:
+      sa [0 .. n-1] holds the suffix array of s
+      t, bkt, bktRec destroyed
+*/
+static void saisMain ( const void* s, Int32 cs, Int32* sa, Int32 n, Int32 k, UInt32* t, Int32* bkt, Int32* bktRec ) {
+  Int32  i;
+  Int32  j;
+  Int32  d;
+  Int32  n1;
+  Int32  name;
+  Int32  pos;
+  Int32  prev;
+  Bool   diff;
+  Int32* s1;
+
+  /*-- Stage 1: sort the LMS substrings. --*/
+  saisClassify ( s, cs, n, t );
+  saisBuckets ( s, cs, n, bkt, k, True );
+  for (i = 0; i < n; i++) {
+    sa[i] = -1;
+  }
+  for (i = 1; i < n; i++) {
+    if (SAIS_ISLMS(i)) {
+      sa[--bkt[SAIS_CHR(i)]] = i;
+    }
+  }
+  saisInduce ( s, cs, sa, n, t, bkt, k );
+
+  /*-- Compact the sorted LMS positions and
+       name the substrings.  Two LMS substrings
+       are equal only if neither reaches the
+       sentinel, which is unique. --*/
+  n1 = 0;
+  for (i = 0; i < n; i++) {
+    if (SAIS_ISLMS(sa[i])) {
+      sa[n1++] = sa[i];
+    }
+  }
+  for (i = n1; i < n; i++) {
+    sa[i] = -1;
+  }
+  name = 0;
+  prev = -1;
+  for (i = 0; i < n1; i++) {
+    pos  = sa[i];
+    diff = False;
+    for (d = 0; ; d++) {
+      if (prev == -1 || pos+d == n || prev+d == n
+          || SAIS_CHR(pos+d) != SAIS_CHR(prev+d)
+          || SAIS_TGET(pos+d) != SAIS_TGET(prev+d)) {
+        diff = True;
+        break;
+      }
+      if (d > 0 && (SAIS_ISLMS(pos+d) || SAIS_ISLMS(prev+d))) {
+        break;
+      }
+    }
+    if (diff) {
+      name++;
+      prev = pos;
+    }
+    sa[n1 + (pos >> 1)] = name - 1;
+  }
+  for (i = n-1, j = n-1; i >= n1; i--) {
+    if (sa[i] >= 0) {
+      sa[j--] = sa[i];
+    }
+  }
+
+  /*-- Stage 2: sort the reduced string, by
+       recursion if the names are not unique. --*/
+  s1 = sa + n - n1;
+  if (name < n1) {
+    saisMain ( s1, 4, sa, n1, name, t, bktRec, bktRec );
+    saisClassify ( s, cs, n, t );
+  }
+  else {
+    for (i = 0; i < n1; i++) {
+      sa[s1[i]] = i;
+    }
+  }
+
+  /*-- Stage 3: induce the full order from the
+       sorted LMS suffixes. --*/
+  for (i = 1, j = 0; i < n; i++) {
+    if (SAIS_ISLMS(i)) {
+      s1[j++] = i;
+    }
+  }
+  for (i = 0; i < n1; i++) {
+    sa[i] = s1[sa[i]];
+  }
+  for (i = n1; i < n; i++) {
+    sa[i] = -1;
+  }
+  saisBuckets ( s, cs, n, bkt, k, True );
+  for (i = n1-1; i >= 0; i--) {
+    j = sa[i];
+    sa[i] = -1;
+    sa[--bkt[SAIS_CHR(j)]] = j;
+  }
+  saisInduce ( s, cs, sa, n, t, bkt, k );
+}
+
+#undef SAIS_TGET
+#undef SAIS_TSET
+#undef SAIS_CHR
+#undef SAIS_ISLMS
+
+
+/*---------------------------------------------*/
+/*--
+   Returns the start of the least rotation of
+   block, or -1 if the block is periodic.  Two
+   candidate starts are compared until one of
+   them loses; if a comparison runs the full
+   length, two distinct rotations are equal.
+--*/
+static Int32 leastRotation ( UChar* block, Int32 nblock ) {
+  Int32 i = 0;
+  Int32 j = 1;
+  Int32 k = 0;
+  Int32 a;
+  Int32 b;
+
+  while (i < nblock && j < nblock && k < nblock) {
+    a = i + k;
+    b = j + k;
+    if (a >= nblock) {
+      a -= nblock;
+    }
+    if (b >= nblock) {
+      b -= nblock;
+    }
+    if (block[a] == block[b]) {
+      k++;
+      continue;
+    }
+    if (block[a] > block[b]) {
+      i += k + 1;
+    }
+    else {
+      j += k + 1;
+    }
+    if (i == j) {
+      j++;
+    }
+    k = 0;
+  }
+  if (k >= nblock) {
+    return -1;
+  }
+  return (i < j) ? i : j;
+}
+
+
+/*---------------------------------------------*/
+static void reverseBytes ( UChar* p, Int32 lo, Int32 hi ) {
+  UChar tmp;
+
+  while (lo < hi) {
+    tmp = p[lo];
+    p[lo] = p[hi];
+    p[hi] = tmp;
+    lo++;
+    hi--;
+  }
+}
+
+
+/*---------------------------------------------*/
+static void rotateBlock ( UChar* block, Int32 nblock, Int32 r ) {
+  if (r == 0) {
+    return;
+  }
+  reverseBytes ( block, 0, r-1 );
+  reverseBytes ( block, r, nblock-1 );
+  reverseBytes ( block, 0, nblock-1 );
+}
+
+
+/*---------------------------------------------*/
+/* Pre:
+      nblock > 0
+      arr2 exists for [0 .. nblockMAX-1 +N_OVERSHOOT]
+      ((UChar*)arr2)  [0 .. nblock-1] holds block
+      arr1 exists for [0 .. nblock-1]
+
+   Post (returns True):
+      ((UChar*)arr2) [0 .. nblock-1] holds block
+      All other areas of arr2 destroyed
+      ftab [ 0 .. 255 ] destroyed
+      arr1 [0 .. nblock-1] holds sorted order
+
+   Returns False, with nothing changed, if the
+   block is periodic.
+
+   Besides the block itself, arr2 has room for
+   at least 3*nblock bytes, which holds the S/L
+   bitmap (nblock/8 bytes) and the bucket array
+   of the recursion levels (at most nblock/2
+   entries).
+*/
+static Bool saisSort ( UInt32* arr1, UInt32* arr2, UInt32* ftab, Int32 nblock ) {
+  UChar*  block = (UChar*)arr2;
+  UInt32* t;
+  Int32*  bktRec;
+  Int32   r;
+  Int32   i;
+
+  r = leastRotation ( block, nblock );
+  if (r < 0) {
+    return False;
+  }
+
+  t      = arr2 + (nblock + BZ_N_OVERSHOOT + 3) / 4;
+  bktRec = (Int32*)(t + (nblock >> 5) + 1);
+
+  rotateBlock ( block, nblock, r );
+  saisMain ( block, 1, (Int32*)arr1, nblock, 256, t, (Int32*)ftab, bktRec );
+  rotateBlock ( block, nblock, nblock - r );
+
+  for (i = 0; i < nblock; i++) {
+    arr1[i] += r;
+    if (arr1[i] >= (UInt32)nblock) {
+      arr1[i] -= nblock;
+    }
+  }
+  return True;
+}
+
+
+/*---------------------------------------------*/
+/*--
+   A cheap look at how repetitive the block is, taken
+   before sorting.  mainGtU pays one budget unit for
+   every 8 matching bytes past the first 12, so what
+   exhausts the budget is many suffixes sharing long
+   prefixes.  The probe picks about one position in 32
+   as an anchor by the hash of its next 8 bytes (so both
+   copies of a repeat land on the same anchors), looks
+   each one up by its next 32 bytes in a hash table of
+   earlier anchors and measures how far the two agree,
+   up to PROBE_MAX_MATCH bytes.  Keying on 32 bytes
+   keeps chance matches in small alphabets from hiding
+   the real, distant repeat.  Short periods may contain
+   no such anchor at all, so after PROBE_MAX_GAP
+   positions without one the next position is taken
+   anyway.  Returns the mean match length over all
+   anchors, in bytes.
+--*/
+#define PROBE_HASH_BITS 14
+#define PROBE_MAX_MATCH 1024
+#define PROBE_MIN_GAP   16
+#define PROBE_MAX_GAP   256
+
+static Int32 probeRepeats ( UChar* block, Int32 nblock ) {
+  Int32  last[1 << PROBE_HASH_BITS];
+  Int32  i, len, cand, end, prev;
+  UInt64 h;
+  UInt64 total   = 0;
+  UInt64 anchors = 0;
+  
+  for (i = 0; i < (1 << PROBE_HASH_BITS); i++) {
+    last[i] = -1;
+  }
+  end  = nblock - PROBE_MAX_MATCH - 8;
+  i    = 0;
+  prev = 0;
+  while (i < end) {
+    h = loadBE64 ( &block[i] ) * 0x9E3779B97F4A7C15ull;
+    if ((h >> 59) != 0 && i - prev < PROBE_MAX_GAP) {
+      i++;
+      continue;
+    }
+    prev = i;
+    h ^= loadBE64 ( &block[i+8] );
+    h *= 0x9E3779B97F4A7C15ull;
+    h ^= loadBE64 ( &block[i+16] );
+    h *= 0x9E3779B97F4A7C15ull;
+    h ^= loadBE64 ( &block[i+24] );
+    h *= 0x9E3779B97F4A7C15ull;
+    h >>= 64 - PROBE_HASH_BITS;
+    cand = last[h];
+    last[h] = i;
+    anchors += 1;
+    if (cand >= 0) {
+      len = 0;
+      while (len < PROBE_MAX_MATCH && loadBE64 ( &block[cand+len] ) == loadBE64 ( &block[i+len] )) {
+        len += 8;
+      }
+      total += len;
+    }
+    i += PROBE_MIN_GAP;
+  }
+  if (anchors == 0) {
+    return 0;
+  }
+  return (Int32)(total / anchors);
+}
+
+#undef PROBE_HASH_BITS
+#undef PROBE_MAX_MATCH
+#undef PROBE_MIN_GAP
+#undef PROBE_MAX_GAP
+
+/*-- mean match bytes per budget unit and position --*/
+static const Int32 PROBE_UNIT = 64;
 
 
 /*---------------------------------------------*/
@@ -984,9 +1881,21 @@ void BZ2_blockSort ( EState* s ) {
   Int32   budget;
   Int32   budgetInit;
   Int32   i;
+  Bool    tryIS;
+  Bool    sortedIS;
+  Bool    packed = (Bool)(s->sortLayout == BZ_LAYOUT_PACKED);
   
-  if (nblock < 10000) {
-    fallbackSort ( s->arr1, s->arr2, ftab, nblock );
+  /*-- With BZ_SORT_SAIS only periodic blocks get
+       past the first test, and SA-IS refuses those. --*/
+  tryIS = (Bool)(s->sortAlgorithm == BZ_SORT_AUTO);
+  
+  if (s->sortAlgorithm == BZ_SORT_SAIS && saisSort ( s->arr1, s->arr2, ftab, nblock )) {
+    /*-- sorted in linear time --*/
+    s->sortStats.sais += 1;
+  }
+  else if (nblock < 10000) {
+    fallbackSort ( s->arr1, s->arr2, ftab, nblock, s->sortPool );
+    s->sortStats.fallback += 1;
   }
   else {
     /* Calculate the location for quadrant, remembering to get
@@ -1016,9 +1925,44 @@ void BZ2_blockSort ( EState* s ) {
     budgetInit = nblock * ((wfact-1) / 3);
     budget = budgetInit;
     
-    mainSort ( ptr, block, quadrant, ftab, nblock, &budget );
-    if (budget < 0) {
-      fallbackSort ( s->arr1, s->arr2, ftab, nblock );
+    /*-- On text, mainSort spends roughly one budget unit
+         per position for every PROBE_UNIT bytes of mean
+         match length the probe sees.  If that predicts
+         an overrun, don't start mainSort at all.  SA-IS
+         refuses periodic blocks; those keep the old path,
+         where mainSort is often cheap for them. --*/
+    sortedIS = False;
+    if (tryIS && probeRepeats ( block, nblock ) > PROBE_UNIT * ((wfact-1) / 3)) {
+      sortedIS = saisSort ( s->arr1, s->arr2, ftab, nblock );
+      tryIS    = False;
+    }
+    
+    if (sortedIS) {
+      s->sortStats.probed += 1;
+      s->sortStats.sais   += 1;
+    }
+    else {
+      mainSort ( ptr, block, quadrant, ftab, nblock, &budget, s->sortPool, s->sortHist, packed );
+      if (packed) {
+        unpackBlock ( block, nblock );
+      }
+      if (budget < 0) {
+        /*-- Too repetitive for mainSort.  SA-IS is
+             linear; unless told to keep the old
+             behaviour, use it for everything but
+             periodic blocks. --*/
+        s->sortStats.abandoned += 1;
+        if (tryIS && saisSort ( s->arr1, s->arr2, ftab, nblock )) {
+          s->sortStats.sais += 1;
+        }
+        else {
+          fallbackSort ( s->arr1, s->arr2, ftab, nblock, s->sortPool );
+          s->sortStats.fallback += 1;
+        }
+      }
+      else {
+        s->sortStats.mainSort += 1;
+      }
     }
   }
   
@@ -56,6 +56,7 @@ Bool    quiet = False;
 #   include <unistd.h>
 #   include <sys/stat.h>
 #   include <sys/times.h>
+#   include <sys/mman.h>
 
 #   define MY_S_ISREG  S_ISREG
 #   define MY_S_ISDIR  S_ISDIR
@@ -121,10 +122,10 @@ void    applySavedFileAttrToOutputFile ( IntNative fd );
 
 typedef struct {
   UChar b[8];
-} UInt64;
+} UInt64Bytes;
 
 
-void uInt64_from_UInt32s ( UInt64* n, UInt32 lo32, UInt32 hi32 ) {
+void uInt64_from_UInt32s ( UInt64Bytes* n, UInt32 lo32, UInt32 hi32 ) {
    n->b[7] = (UChar)((hi32 >> 24) & 0xFF);
    n->b[6] = (UChar)((hi32 >> 16) & 0xFF);
    n->b[5] = (UChar)((hi32 >> 8)  & 0xFF);
@@ -136,7 +137,7 @@ void uInt64_from_UInt32s ( UInt64* n, UInt32 lo32, UInt32 hi32 ) {
 }
 
 
-double uInt64_to_double ( UInt64* n ) {
+double uInt64_to_double ( UInt64Bytes* n ) {
    double base = 1.0;
    double sum  = 0.0;
    for (int i = 0; i < 8; i++) {
@@ -147,7 +148,7 @@ double uInt64_to_double ( UInt64* n ) {
 }
 
 
-Bool uInt64_isZero ( UInt64* n ) {
+Bool uInt64_isZero ( UInt64Bytes* n ) {
   for (int i = 0; i < 8; i++) {
     if (n->b[i] != 0) {
       return 0;
@@ -165,15 +166,15 @@ Bool uInt64_isZero ( UInt64* n ) {
  Das Ergebnis der Division wird in den Bytes des Eingabeparameters `n` gespeichert,
  und der Rest der Division wird als Rückgabewert zurückgegeben.
  
- @param n Ein Zeiger auf eine 64-Bit-Ganzzahl (UInt64), die durch 10 geteilt werden soll.
+ @param n Ein Zeiger auf eine 64-Bit-Ganzzahl (UInt64Bytes), die durch 10 geteilt werden soll.
  Die Bytes des Ergebnisses werden in diesem Parameter gespeichert.
  
  @return Der Rest der Division (0-9).
  
- @note Die Funktion modifiziert den Inhalt des übergebenen `UInt64`-Parameters `n`.
+ @note Die Funktion modifiziert den Inhalt des übergebenen `UInt64Bytes`-Parameters `n`.
  
  @code
- UInt64 myNumber;
+ UInt64Bytes myNumber;
  myNumber.b[0] = 0;
  myNumber.b[1] = 0;
  myNumber.b[2] = 0;
@@ -191,7 +192,7 @@ Bool uInt64_isZero ( UInt64* n ) {
  // remainder == 0
  @endcode
  */
-Int32 uInt64_qrm10 ( UInt64* n ) {
+Int32 uInt64_qrm10 ( UInt64Bytes* n ) {
   UInt32 rem;
   UInt32 tmp;
   rem = 0;
@@ -205,9 +206,9 @@ Int32 uInt64_qrm10 ( UInt64* n ) {
 
 
 /** (KI generierte Dokumentation)
- @brief Konvertiert einen UInt64-Wert in eine ASCII-Zeichenkette.
+ @brief Konvertiert einen UInt64Bytes-Wert in eine ASCII-Zeichenkette.
  
- Diese Funktion konvertiert einen gegebenen UInt64-Wert in seine entsprechende
+ Diese Funktion konvertiert einen gegebenen UInt64Bytes-Wert in seine entsprechende
  ASCII-Zeichenkettendarstellung. Die resultierende Zeichenkette wird in den
  bereitgestellten Ausgabepuffer geschrieben.
  
@@ -215,7 +216,7 @@ Int32 uInt64_qrm10 ( UInt64* n ) {
  geschrieben wird. Der Puffer muss ausreichend groß sein, um die
  resultierende Zeichenkette aufzunehmen (maximal 20 Zeichen + Nullterminierung).
  
- @param n Ein Zeiger auf den UInt64-Wert, der konvertiert werden soll.
+ @param n Ein Zeiger auf den UInt64Bytes-Wert, der konvertiert werden soll.
  
  @discussion Die Funktion verwendet interne Hilfsfunktionen `uInt64_qrm10` und
  `uInt64_isZero`, um die Konvertierung durchzuführen. Die resultierende
@@ -225,7 +226,7 @@ Int32 uInt64_qrm10 ( UInt64* n ) {
  keine Fehlerprüfung auf die Größe des Puffers durchgeführt.
  
  @code
- UInt64 value = 1234567890123456789ULL;
+ UInt64Bytes value = 1234567890123456789ULL;
  char buffer[21]; // 20 Ziffern + Nullterminierung
  uInt64_toAscii(buffer, &value);
  // buffer enthält nun "1234567890123456789"
@@ -235,11 +236,11 @@ Int32 uInt64_qrm10 ( UInt64* n ) {
  
  @see uInt64_isZero
  */
-void uInt64_toAscii ( char* outbuf, UInt64* n ) {
+void uInt64_toAscii ( char* outbuf, UInt64Bytes* n ) {
   Int32  q;
   UChar  buf[32];
   Int32  nBuf   = 0;
-  UInt64 n_copy = *n;
+  UInt64Bytes n_copy = *n;
   do {
     q = uInt64_qrm10 ( &n_copy );
     buf[nBuf] = q + '0';
@@ -394,6 +395,126 @@ inline void handleErrorsAndExitApplication (int* bzerror, BZFILE* bzf, int aband
   /*notreached*/
 }
 
+
+/*---------------------------------------------*/
+/*--
+  Größe des Ausgabepuffers und der Eingabehappen
+  für die Verarbeitung von eingeblendeten Dateien.
+--*/
+const int MAPPED_OUTPUT_SIZE = 65536;
+const unsigned int MAPPED_CHUNK_SIZE = 0x40000000;
+
+/**
+ @brief Blendet eine reguläre Eingabedatei in den Speicher ein.
+
+ @param stream Der Eingabestrom, der noch nicht gelesen wurde.
+ @param length Liefert die Länge der Einblendung in Bytes.
+
+ @return Die Anfangsadresse der Einblendung oder `NULL`, wenn der Strom keine
+ nicht-leere reguläre Datei ist (z.B. eine Pipe) oder die Einblendung scheitert.
+ In diesem Fall muss der Aufrufer über stdio lesen.
+
+ @discussion Dem Betriebssystem wird mit `madvise` ein sequentieller Zugriff
+ angekündigt, so dass es vorausliest und gelesene Seiten früh freigeben kann.
+
+ @see unmapInputFile
+ */
+UChar* mapInputFile ( FILE* stream, size_t* length ) {
+  struct stat statBuffer;
+  void*       mapping;
+  IntNative   fd = fileno ( stream );
+
+  if (fd < 0 || fstat ( fd, &statBuffer ) != 0) {
+    return NULL;
+  }
+  if (!MY_S_ISREG(statBuffer.st_mode) || statBuffer.st_size <= 0) {
+    return NULL;
+  }
+  // der Strom darf noch nicht gelesen worden sein
+  if (ftello ( stream ) != 0) {
+    return NULL;
+  }
+  if ((off_t)(size_t)statBuffer.st_size != statBuffer.st_size) {
+    return NULL;
+  }
+  mapping = mmap ( NULL, (size_t)statBuffer.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+  if (mapping == MAP_FAILED) {
+    return NULL;
+  }
+  madvise ( mapping, (size_t)statBuffer.st_size, MADV_SEQUENTIAL );
+  *length = (size_t)statBuffer.st_size;
+  return (UChar*)mapping;
+}
+
+/**
+ @brief Gibt eine mit `mapInputFile` erzeugte Einblendung wieder frei.
+ */
+void unmapInputFile ( UChar* mapping, size_t length ) {
+  munmap ( mapping, length );
+}
+
+/**
+ @brief Komprimiert eine eingeblendete Eingabedatei in den Ausgabestrom.
+
+ @param data Die eingeblendete Eingabe.
+ @param length Die Länge der Eingabe in Bytes.
+ @param zStream Der Ausgabestrom für die komprimierten Daten.
+
+ @discussion Die Bibliothek liest direkt aus der Einblendung, es entfällt also
+ das Kopieren über `fread` und den Puffer von `BZFILE`. Fehler werden wie in
+ `compressStream` behandelt und beenden die Anwendung.
+ */
+void compressMappedInput ( UChar* data, size_t length, FILE* zStream ) {
+  static UChar obuf[MAPPED_OUTPUT_SIZE];
+  bz_stream strm;
+  size_t    remaining = length;
+  size_t    produced;
+  Int32     action = BZ_RUN;
+  Int32     bzerr_dummy;
+  Int32     ret;
+
+  strm.bzalloc = NULL;
+  strm.bzfree = NULL;
+  strm.opaque = NULL;
+  ret = BZ2_bzCompressInit ( &strm, blockSize100k, workFactor );
+  if (ret != BZ_OK) {
+    handleErrorsAndExitApplication (&bzerr_dummy, NULL, 1, NULL, NULL, NULL, NULL, ret);
+  }
+  strm.avail_in = 0;
+
+  while (True) {
+    // nächsten Happen der Einblendung übergeben
+    if (strm.avail_in == 0 && remaining > 0) {
+      strm.next_in = (char*)data;
+      strm.avail_in = remaining < MAPPED_CHUNK_SIZE ? (unsigned int)remaining : MAPPED_CHUNK_SIZE;
+      data += strm.avail_in;
+      remaining -= strm.avail_in;
+    }
+    if (remaining == 0) {
+      action = BZ_FINISH;
+    }
+    strm.next_out = (char*)obuf;
+    strm.avail_out = MAPPED_OUTPUT_SIZE;
+    ret = BZ2_bzCompress ( &strm, action );
+    if (ret < 0) {
+      BZ2_bzCompressEnd ( &strm );
+      handleErrorsAndExitApplication (&bzerr_dummy, NULL, 1, NULL, NULL, NULL, NULL, ret);
+    }
+    produced = MAPPED_OUTPUT_SIZE - strm.avail_out;
+    if (produced > 0) {
+      fwrite ( obuf, sizeof(UChar), produced, zStream );
+    }
+    if (ferror(zStream)) {
+      // führe die Fehlerbehandlung aus
+      handleIoErrorsAndExitApplication();
+    }
+    if (ret == BZ_STREAM_END) {
+      break;
+    }
+  }
+  BZ2_bzCompressEnd ( &strm );
+}
+
 void compressStream ( FILE *stream, FILE *zStream ) {
   BZFILE* bzf = NULL;
   UChar   buffer[BUFFER_SIZE];
@@ -405,6 +526,8 @@ void compressStream ( FILE *stream, FILE *zStream ) {
   Int32   bzerr;
   Int32   bzerr_dummy;
   Int32   ret;
+  UChar*  mapped;
+  size_t  mappedLength;
   
   if (ferror(stream)) {
     // führe die Fehlerbehandlung aus
@@ -415,42 +538,50 @@ void compressStream ( FILE *stream, FILE *zStream ) {
     handleIoErrorsAndExitApplication();
   }
   
-  bzf = BZ2_bzWriteOpen ( &bzerr, zStream, blockSize100k, workFactor );
-  if (bzerr != BZ_OK) {
-    // führe die Fehlerbehandlung aus
-    handleErrorsAndExitApplication (&bzerr_dummy, bzf, 1, &nbytes_in_lo32, &nbytes_in_hi32, &nbytes_out_lo32, &nbytes_out_hi32, bzerr);
+  mapped = mapInputFile ( stream, &mappedLength );
+  if (mapped != NULL) {
+    // reguläre Datei: direkt aus der Einblendung komprimieren
+    compressMappedInput ( mapped, mappedLength, zStream );
+    unmapInputFile ( mapped, mappedLength );
   }
-  
-  // Arbeite bis zum Ende aller Tage
-  while (True) {
-    // Wenn das Ende des Eingabestroms erreicht ist
-    if (myfeof(stream)) {
-      // Beende die Schleife
-      break;
-    }
-    // Lese aus dem Eingabstrom `stream` maximal soviele Elemente wie in `bufferSize` definiert ist, wobei ein Elemen eine Anzahl von Bytes entspricht die `sizeof(UChar)` zurückgibt und speicher diese im Puffer `buffer`. Die Anzahl der gelesenen Zeichen speichere dabei in `countOfElementsInBuffer`.
-    countOfElementsInBuffer = fread ( buffer, sizeof(UChar), BUFFER_SIZE, stream );
-    // prüfe, ob beim lesen ein Fehler aufgetreten ist
-    if (ferror(stream)) {
+  else {
+    bzf = BZ2_bzWriteOpen ( &bzerr, zStream, blockSize100k, workFactor );
+    if (bzerr != BZ_OK) {
       // führe die Fehlerbehandlung aus
-      handleIoErrorsAndExitApplication();
+      handleErrorsAndExitApplication (&bzerr_dummy, bzf, 1, &nbytes_in_lo32, &nbytes_in_hi32, &nbytes_out_lo32, &nbytes_out_hi32, bzerr);
     }
-    // Wenn aus dem Strom etwas gelesen wurde
-    if (countOfElementsInBuffer > 0) {
-      // rufe die Funktion `BZ2_bzWrite` auf
-      BZ2_bzWrite ( &bzerr, bzf, (void*)buffer, (int)countOfElementsInBuffer );
+    
+    // Arbeite bis zum Ende aller Tage
+    while (True) {
+      // Wenn das Ende des Eingabestroms erreicht ist
+      if (myfeof(stream)) {
+        // Beende die Schleife
+        break;
+      }
+      // Lese aus dem Eingabstrom `stream` maximal soviele Elemente wie in `bufferSize` definiert ist, wobei ein Elemen eine Anzahl von Bytes entspricht die `sizeof(UChar)` zurückgibt und speicher diese im Puffer `buffer`. Die Anzahl der gelesenen Zeichen speichere dabei in `countOfElementsInBuffer`.
+      countOfElementsInBuffer = fread ( buffer, sizeof(UChar), BUFFER_SIZE, stream );
+      // prüfe, ob beim lesen ein Fehler aufgetreten ist
+      if (ferror(stream)) {
+        // führe die Fehlerbehandlung aus
+        handleIoErrorsAndExitApplication();
+      }
+      // Wenn aus dem Strom etwas gelesen wurde
+      if (countOfElementsInBuffer > 0) {
+        // rufe die Funktion `BZ2_bzWrite` auf
+        BZ2_bzWrite ( &bzerr, bzf, (void*)buffer, (int)countOfElementsInBuffer );
+      }
+      if (bzerr != BZ_OK) {
+        // führe die Fehlerbehandlung aus
+        handleErrorsAndExitApplication (&bzerr_dummy, bzf, 1, &nbytes_in_lo32, &nbytes_in_hi32, &nbytes_out_lo32, &nbytes_out_hi32, bzerr);
+      }
     }
+    // MARK: hier erfolgt nicht nur das schreiben sondern auch die eigentlich Komprimierung :-(
+    BZ2_bzWriteClose64 ( &bzerr, bzf, 0, &nbytes_in_lo32, &nbytes_in_hi32, &nbytes_out_lo32, &nbytes_out_hi32 );
     if (bzerr != BZ_OK) {
       // führe die Fehlerbehandlung aus
       handleErrorsAndExitApplication (&bzerr_dummy, bzf, 1, &nbytes_in_lo32, &nbytes_in_hi32, &nbytes_out_lo32, &nbytes_out_hi32, bzerr);
     }
   }
-  // MARK: hier erfolgt nicht nur das schreiben sondern auch die eigentlich Komprimierung :-(
-  BZ2_bzWriteClose64 ( &bzerr, bzf, 0, &nbytes_in_lo32, &nbytes_in_hi32, &nbytes_out_lo32, &nbytes_out_hi32 );
-  if (bzerr != BZ_OK) {
-    // führe die Fehlerbehandlung aus
-    handleErrorsAndExitApplication (&bzerr_dummy, bzf, 1, &nbytes_in_lo32, &nbytes_in_hi32, &nbytes_out_lo32, &nbytes_out_hi32, bzerr);
-  }
   
   if (ferror(zStream)) {
     // führe die Fehlerbehandlung aus
@@ -493,6 +624,155 @@ void compressStream ( FILE *stream, FILE *zStream ) {
 }
 
 
+/**
+ @brief Liefert die Anzahl der Threads für das Dekomprimieren eingeblendeter
+ Dateien.
+
+ @return Die Anzahl der verfügbaren Prozessorkerne, höchstens `BZ_MAX_THREADS`.
+ Im `smallMode` immer 1, da jeder Thread eigene Blockpuffer braucht.
+ */
+Int32 decompressThreads ( void ) {
+  long n;
+
+  if (smallMode) {
+    return 1;
+  }
+  n = sysconf ( _SC_NPROCESSORS_ONLN );
+  if (n < 1) {
+    return 1;
+  }
+  return n > BZ_MAX_THREADS ? BZ_MAX_THREADS : (Int32)n;
+}
+
+/**
+ @brief Schreibt dekomprimierte Daten von `BZ2_decompressMT` in den
+ Ausgabestrom.
+
+ @param opaque Der Ausgabestrom oder `NULL`, wenn nur getestet wird.
+ */
+Int32 writeMappedOutput ( void* opaque, const UChar* buf, UInt32 len ) {
+  FILE* stream = (FILE*)opaque;
+
+  if (stream != NULL) {
+    fwrite ( buf, sizeof(UChar), len, stream );
+    if (ferror(stream)) {
+      // führe die Fehlerbehandlung aus
+      handleIoErrorsAndExitApplication();
+    }
+  }
+  return BZ_OK;
+}
+
+/**
+ @brief Dekomprimiert eine eingeblendete Eingabedatei in den Ausgabestrom.
+
+ @param data Die eingeblendete komprimierte Eingabe.
+ @param length Die Länge der Eingabe in Bytes.
+ @param stream Der Ausgabestrom oder `NULL`, wenn nur getestet wird.
+ @param streamNo Zählt die begonnenen bzip2-Ströme.
+
+ @return `BZ_OK`, wenn alle Ströme vollständig dekomprimiert wurden, sonst den
+ Fehlercode der Bibliothek. `BZ_UNEXPECTED_EOF` meldet eine abgeschnittene
+ Eingabe, `BZ_DATA_ERROR_MAGIC` einen Strom ohne gültigen Kopf.
+
+ @discussion Die Eingabe wird ohne Zwischenpuffer direkt aus der Einblendung
+ gelesen. Aufeinanderfolgende Ströme werden wie in `uncompressStream` nacheinander
+ dekomprimiert.
+
+ @see uncompressMappedInputMT
+ */
+Int32 uncompressMappedInput ( UChar* data, size_t length, FILE* stream, Int32* streamNo ) {
+  static UChar obuf[MAPPED_OUTPUT_SIZE];
+  bz_stream strm;
+  size_t    remaining = length;
+  size_t    produced;
+  Int32     ret;
+
+  while (True) {
+    strm.bzalloc = NULL;
+    strm.bzfree = NULL;
+    strm.opaque = NULL;
+    ret = BZ2_bzDecompressInit ( &strm, (int)smallMode );
+    if (ret != BZ_OK) {
+      return ret;
+    }
+    *streamNo += 1;
+    strm.avail_in = 0;
+
+    while (True) {
+      // nächsten Happen der Einblendung übergeben
+      if (strm.avail_in == 0 && remaining > 0) {
+        strm.next_in = (char*)data;
+        strm.avail_in = remaining < MAPPED_CHUNK_SIZE ? (unsigned int)remaining : MAPPED_CHUNK_SIZE;
+        data += strm.avail_in;
+        remaining -= strm.avail_in;
+      }
+      strm.next_out = (char*)obuf;
+      strm.avail_out = MAPPED_OUTPUT_SIZE;
+      ret = BZ2_bzDecompress ( &strm );
+      if (ret != BZ_OK && ret != BZ_STREAM_END) {
+        BZ2_bzDecompressEnd ( &strm );
+        return ret;
+      }
+      produced = MAPPED_OUTPUT_SIZE - strm.avail_out;
+      if (produced > 0 && stream != NULL) {
+        fwrite ( obuf, sizeof(UChar), produced, stream );
+        if (ferror(stream)) {
+          // führe die Fehlerbehandlung aus
+          handleIoErrorsAndExitApplication();
+        }
+      }
+      if (ret == BZ_STREAM_END) {
+        break;
+      }
+      // Eingabe verbraucht, ohne dass der Strom endet
+      if (strm.avail_in == 0 && remaining == 0 && produced == 0) {
+        BZ2_bzDecompressEnd ( &strm );
+        return BZ_UNEXPECTED_EOF;
+      }
+    }
+
+    // unverbrauchte Bytes gehören zum nächsten Strom
+    data = (UChar*)strm.next_in;
+    remaining += strm.avail_in;
+    BZ2_bzDecompressEnd ( &strm );
+    if (remaining == 0) {
+      return BZ_OK;
+    }
+  }
+}
+
+/**
+ @brief Dekomprimiert eine eingeblendete Eingabedatei mit mehreren Threads.
+
+ Parameter und Rückgabewert wie bei `uncompressMappedInput`.
+
+ @discussion Mit mehr als einem Prozessorkern dekodiert `BZ2_decompressMT` die
+ Blöcke parallel und schreibt sie in Reihenfolge in den Ausgabestrom, sonst
+ wird `uncompressMappedInput` aufgerufen. Scheitert das parallele
+ Dekomprimieren an den Daten, wird die Eingabe noch einmal sequentiell und ohne
+ Ausgabe gelesen, damit Fehlercode und `streamNo` nicht von der Anzahl der
+ Kerne abhängen.
+ */
+Int32 uncompressMappedInputMT ( UChar* data, size_t length, FILE* stream, Int32* streamNo ) {
+  Int32 nThreads = decompressThreads ();
+  Int32 ret;
+  Int32 seqRet;
+
+  if (nThreads <= 1) {
+    return uncompressMappedInput ( data, length, stream, streamNo );
+  }
+  ret = BZ2_decompressMT ( data, length, (Int32)smallMode, nThreads, True, writeMappedOutput, stream, streamNo );
+  if (ret == BZ_OK || ret == BZ_DATA_ERROR_MAGIC || ret == BZ_MEM_ERROR) {
+    return ret;
+  }
+  *streamNo = 0;
+  seqRet = uncompressMappedInput ( data, length, NULL, streamNo );
+  // die Ausgabe ist unvollständig, also nie als Erfolg melden
+  return (seqRet == BZ_OK) ? ret : seqRet;
+}
+
+
 /*---------------------------------------------*/
 Bool uncompressStream ( FILE *zStream, FILE *stream ) {
   const int bufferSize = 5000;
@@ -504,10 +784,12 @@ Bool uncompressStream ( FILE *zStream, FILE *stream ) {
   Int32 streamNo;
   Int32 i;
   UChar   obuf[bufferSize];
-  UChar   unused[bufferSize];
+  static UChar unused[BZ_IO_BUFFER_SIZE];
   Int32   nUnused;
   void*   unusedTmpV;
   UChar*  unusedTmp;
+  UChar*  mapped;
+  size_t  mappedLength;
   
   nUnused = 0;
   streamNo = 0;
@@ -521,9 +803,23 @@ Bool uncompressStream ( FILE *zStream, FILE *stream ) {
     handleIoErrorsAndExitApplication();
   }
   
+  mapped = mapInputFile ( zStream, &mappedLength );
+  if (mapped != NULL) {
+    // reguläre Datei: direkt aus der Einblendung dekomprimieren
+    bzerr = uncompressMappedInputMT ( mapped, mappedLength, stream, &streamNo );
+    unmapInputFile ( mapped, mappedLength );
+    if (bzerr == BZ_OK) {
+      goto closeok;
+    }
+    if (bzerr == BZ_DATA_ERROR_MAGIC) {
+      goto trycat;
+    }
+    goto errhandler;
+  }
+  
   while (True) {
     
-    bzf = BZ2_bzReadOpen ( &bzerr, zStream, (int)smallMode, unused, nUnused );
+    bzf = BZ2_bzReadOpenBuffered ( &bzerr, zStream, (int)smallMode, unused, nUnused, BZ_IO_BUFFER_SIZE );
     if (bzf == NULL || bzerr != BZ_OK) {
       goto errhandler;
     }
@@ -667,10 +963,12 @@ Bool testStream ( FILE *zStream ) {
   BZFILE* bzf = NULL;
   Int32   bzerr, bzerr_dummy, ret, streamNo, i;
   UChar   obuf[bufferSize];
-  UChar   unused[bufferSize];
+  static UChar unused[BZ_IO_BUFFER_SIZE];
   Int32   nUnused;
   void*   unusedTmpV;
   UChar*  unusedTmp;
+  UChar*  mapped;
+  size_t  mappedLength;
   
   nUnused = 0;
   streamNo = 0;
@@ -679,9 +977,19 @@ Bool testStream ( FILE *zStream ) {
     handleIoErrorsAndExitApplication();
   }
   
+  mapped = mapInputFile ( zStream, &mappedLength );
+  if (mapped != NULL) {
+    bzerr = uncompressMappedInputMT ( mapped, mappedLength, NULL, &streamNo );
+    unmapInputFile ( mapped, mappedLength );
+    if (bzerr != BZ_OK) {
+      goto errhandler;
+    }
+    goto closeok;
+  }
+  
   while (True) {
     
-    bzf = BZ2_bzReadOpen ( &bzerr, zStream, (int)smallMode, unused, nUnused );
+    bzf = BZ2_bzReadOpenBuffered ( &bzerr, zStream, (int)smallMode, unused, nUnused, BZ_IO_BUFFER_SIZE );
     if (bzf == NULL || bzerr != BZ_OK) {
       goto errhandler;
     }
@@ -715,6 +1023,7 @@ Bool testStream ( FILE *zStream ) {
     
   }
   
+closeok:
   if (ferror(zStream)) {
     handleIoErrorsAndExitApplication();
   }
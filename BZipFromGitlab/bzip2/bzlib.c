@@ -129,8 +129,51 @@ static Bool isempty_RL ( EState* s ) {
   }
 }
 
+/*---------------------------------------------------*/
+/*--
+   Size of arr1/arr2 in entries for a stream of at most
+   sizeHint bytes (0: unknown).  The first run-length
+   stage turns 4 equal bytes plus a count into 5 bytes,
+   so a block never exceeds 5/4 of its input; with the
+   slack below, input within the hint never fills the
+   smaller block early.  The lower bound keeps room for
+   the compressed block, which is written behind the
+   block data in arr2 and carries up to ~7 KB of tables.
+--*/
+static const int BZ_MIN_BLOCK_ALLOC = 10000;
+
+static Int32 block_alloc_size ( Int32 blockSize100k, UInt32 sizeHint ) {
+  Int32  n = 100000 * blockSize100k;
+  UInt32 need;
+  
+  if (sizeHint == 0 || sizeHint >= (UInt32)n) {
+    return n;
+  }
+  need = sizeHint + sizeHint / 4 + 64;
+  if (need < (UInt32)BZ_MIN_BLOCK_ALLOC) {
+    need = BZ_MIN_BLOCK_ALLOC;
+  }
+  return (need < (UInt32)n) ? (Int32)need : n;
+}
+
+
 /*---------------------------------------------------*/
 int BZ2_bzCompressInit ( bz_stream* strm, int blockSize100k, int workFactor ) {
+  return BZ2_bzCompressInitSized ( strm, blockSize100k, workFactor, 0 );
+}
+
+
+/*---------------------------------------------------*/
+/**
+ * @brief Wie `BZ2_bzCompressInit`, belegt die Blockpuffer aber nur so
+ * groß, wie `sizeHint` Bytes Eingabe brauchen.
+ *
+ * Bleibt die gesamte Eingabe innerhalb von `sizeHint`, ist die Ausgabe
+ * identisch zu der von `BZ2_bzCompressInit`. Mehr Eingabe wird weiterhin
+ * korrekt komprimiert, dann aber in kleineren Blöcken. 0 bedeutet keine
+ * Angabe.
+ */
+int BZ2_bzCompressInitSized ( bz_stream* strm, int blockSize100k, int workFactor, unsigned int sizeHint ) {
   Int32   n;
   EState* s;
   
@@ -161,7 +204,7 @@ int BZ2_bzCompressInit ( bz_stream* strm, int blockSize100k, int workFactor ) {
   s->arr2 = NULL;
   s->ftab = NULL;
   
-  n       = 100000 * blockSize100k;
+  n       = block_alloc_size ( blockSize100k, sizeHint );
   s->arr1 = BZALLOC( n                  * sizeof(UInt32) );
   s->arr2 = BZALLOC( (n+BZ_N_OVERSHOOT) * sizeof(UInt32) );
   s->ftab = BZALLOC( 65537              * sizeof(UInt32) );
@@ -187,13 +230,20 @@ int BZ2_bzCompressInit ( bz_stream* strm, int blockSize100k, int workFactor ) {
   s->modus              = BZ_MODUS_RUNNING;
   s->combinedCRC       = 0;
   s->blockSize100k     = blockSize100k;
-  s->nblockMAX         = 100000 * blockSize100k - 19;
+  s->nblockMAX         = n - 19;
   s->workFactor        = workFactor;
+  s->sortAlgorithm     = BZ_SORT_AUTO;
+  s->sortLayout        = BZ_LAYOUT_SPLIT;
+  s->tableTolerance    = 0;
+  s->sortPool          = NULL;
+  s->sortHist          = NULL;
+  memset ( &s->sortStats, 0, sizeof(s->sortStats) );
   
   s->block             = (UChar*)s->arr2;
   s->mtfv              = (UInt16*)s->arr1;
   s->zbits             = NULL;
   s->ptr               = (UInt32*)s->arr1;
+  s->mt                = NULL;
   
   strm->state          = s;
   strm->total_in_lo32  = 0;
@@ -207,11 +257,7 @@ int BZ2_bzCompressInit ( bz_stream* strm, int blockSize100k, int workFactor ) {
 
 /*---------------------------------------------------*/
 static void add_pair_to_block ( EState* s ) {
-  Int32 i;
   UChar ch = (UChar)(s->state_in_ch);
-  for (i = 0; i < s->state_in_len; i++) {
-    BZ_UPDATE_CRC(&s->blockCRC, ch); // Funktionsaufruf (Pointer)
-  }
   s->inUse[s->state_in_ch] = True;
   switch (s->state_in_len) {
     case 1:
@@ -251,6 +297,7 @@ static void add_pair_to_block ( EState* s ) {
 /*---------------------------------------------------*/
 static void flush_RL ( EState* s ) {
   if (s->state_in_ch < 256) {
+    s->blockCRC = BZ2_crcUpdateRun ( s->blockCRC, (UChar)(s->state_in_ch), (UInt32)(s->state_in_len) );
     add_pair_to_block ( s );
   }
   init_RL ( s );
@@ -264,7 +311,6 @@ static void flush_RL ( EState* s ) {
    if (zchh != zs->state_in_ch &&                 \
        zs->state_in_len == 1) {                   \
       UChar ch = (UChar)(zs->state_in_ch);        \
-      BZ_UPDATE_CRC(&zs->blockCRC, ch);           \
       zs->inUse[zs->state_in_ch] = True;          \
       zs->block[zs->nblock] = (UChar)ch;          \
       zs->nblock += 1;                               \
@@ -285,8 +331,20 @@ static void flush_RL ( EState* s ) {
 
 
 /*---------------------------------------------------*/
+/*--
+   The block CRC covers the input bytes in the block. They
+   are the bytes taken in here, minus the run still pending
+   at the end, plus the run pending at the start; all of a
+   pending run are copies of one byte, so only the bytes
+   taken in here need to be read again.
+--*/
 static Bool copy_input_until_stop ( EState* s ) {
-  Bool progress_in = False;
+  Bool   progress_in = False;
+  UChar* start       = (UChar*)s->strm->next_in;
+  UChar  pendCh      = (UChar)(s->state_in_ch);
+  UInt32 pendLen     = (s->state_in_ch < 256) ? (UInt32)(s->state_in_len) : 0;
+  UInt32 taken;
+  UInt32 added;
   
   if (s->modus == BZ_MODUS_RUNNING) {
     /*-- fast track the common case --*/
@@ -335,6 +393,15 @@ static Bool copy_input_until_stop ( EState* s ) {
       s->avail_in_expect -= 1;
     }
   }
+  
+  taken = (UInt32)((UChar*)s->strm->next_in - start);
+  added = pendLen + taken - ((s->state_in_ch < 256) ? (UInt32)(s->state_in_len) : 0);
+  if (added > 0) {
+    s->blockCRC = BZ2_crcUpdateRun ( s->blockCRC, pendCh, (added < pendLen) ? added : pendLen );
+    if (added > pendLen) {
+      s->blockCRC = BZ2_crcUpdate ( s->blockCRC, start, added - pendLen );
+    }
+  }
   return progress_in;
 }
 
@@ -369,6 +436,273 @@ static Bool copy_output_until_stop ( EState* s ) {
 }
 
 
+/*---------------------------------------------------*/
+/*--- Block-parallel compression                  ---*/
+/*---------------------------------------------------*/
+
+/*--
+   Im Mehrthread-Modus füllt der aufrufende Thread weiterhin
+   die Blöcke. Ein voller Block wird samt Puffern an einen
+   freien Auftrag übergeben und von einem Arbeits-Thread ohne
+   Stream-Kopf komprimiert. Die fertigen Blöcke werden streng
+   in Eingabereihenfolge bitgenau aneinandergehängt, so dass
+   die Ausgabe der sequentiellen Kompression entspricht.
+--*/
+
+/*---------------------------------------------------*/
+static void mt_compress_job ( void* arg ) {
+  MTJob* job = (MTJob*)arg;
+  job->nBits = BZ2_compressBlockBits ( job->es );
+}
+
+
+/*---------------------------------------------------*/
+static void set_block_aliases ( EState* s ) {
+  s->block = (UChar*)s->arr2;
+  s->mtfv  = (UInt16*)s->arr1;
+  s->ptr   = (UInt32*)s->arr1;
+}
+
+
+/*---------------------------------------------------*/
+static void mt_submit_block ( EState* s ) {
+  MTState* mt  = s->mt;
+  MTJob*   job = &mt->jobs[(mt->head + mt->count) % mt->nJobs];
+  EState*  js  = job->es;
+  UInt32*  tmp;
+  
+  BZ_FINALISE_CRC ( &s->blockCRC );
+  s->combinedCRC = BZ2_bzCombineCRC ( s->combinedCRC, s->blockCRC, 1 );
+  
+  /*-- Der Auftrag übernimmt den gefüllten Block, wir seine freien Puffer. --*/
+  tmp = js->arr1; js->arr1 = s->arr1; s->arr1 = tmp;
+  tmp = js->arr2; js->arr2 = s->arr2; s->arr2 = tmp;
+  set_block_aliases ( s );
+  set_block_aliases ( js );
+  
+  js->nblock        = s->nblock;
+  js->blockCRC      = s->blockCRC;
+  js->workFactor    = s->workFactor;
+  js->sortAlgorithm = s->sortAlgorithm;
+  js->sortLayout    = s->sortLayout;
+  js->tableTolerance = s->tableTolerance;
+  memcpy ( js->inUse, s->inUse, sizeof(s->inUse) );
+  
+  BZ2_poolSubmit ( mt->pool, &job->task );
+  mt->count += 1;
+}
+
+
+/*---------------------------------------------------*/
+/*-- zählt die Sortierungen eines Auftrags zum Strom und leert sie --*/
+static void add_sort_stats ( bz_sort_stats* to, bz_sort_stats* from ) {
+  to->mainSort  += from->mainSort;
+  to->sais      += from->sais;
+  to->fallback  += from->fallback;
+  to->probed    += from->probed;
+  to->abandoned += from->abandoned;
+  memset ( from, 0, sizeof(*from) );
+}
+
+
+/*---------------------------------------------------*/
+static Bool pending_output ( EState* s ) {
+  if (s->state_out_pos < s->numZ) {
+    return True;
+  }
+  if (s->mt != NULL) {
+    if (s->mt->count > 0) {
+      return True;
+    }
+    if (s->modus == BZ_MODUS_FINISHING && !s->mt->trailerDone) {
+      return True;
+    }
+  }
+  return False;
+}
+
+
+/*---------------------------------------------------*/
+static Bool handle_compress_mt ( bz_stream* strm ) {
+  Bool progress_in  = False;
+  Bool progress_out = False;
+  EState*  s  = strm->state;
+  MTState* mt = s->mt;
+  
+  while (True) {
+    if (!s->statusInputEqualsTrueVsOutputEqualsFalse) {
+      progress_out |= copy_output_until_stop (s);
+      if (s->state_out_pos < s->numZ) {
+        break;
+      }
+      if (mt->emitting) {
+        mt->head = (mt->head + 1) % mt->nJobs;
+        mt->count -= 1;
+        mt->emitting = False;
+      }
+      s->statusInputEqualsTrueVsOutputEqualsFalse = True;
+    }
+    
+    progress_in |= copy_input_until_stop (s);
+    Bool ended = (s->modus != BZ_MODUS_RUNNING && s->avail_in_expect == 0);
+    if (ended) {
+      flush_RL (s);
+    }
+    Bool needSlot = (s->nblock >= s->nblockMAX) || (ended && s->nblock > 0);
+    if (needSlot && mt->count < mt->nJobs) {
+      mt_submit_block (s);
+      prepare_new_block (s);
+      needSlot = False;
+    }
+    
+    /*-- Den ältesten Block ausgeben, sobald er fertig ist. --*/
+    if (mt->count > 0) {
+      MTJob* job = &mt->jobs[mt->head];
+      if (needSlot || ended) {
+        BZ2_poolWait ( mt->pool, &job->task );
+      }
+      if (BZ2_poolIsDone ( mt->pool, &job->task )) {
+        add_sort_stats ( &s->sortStats, &job->es->sortStats );
+        BZ2_bsSpliceBlock ( s, job->es->zbits, job->nBits );
+        mt->emitting = True;
+        s->statusInputEqualsTrueVsOutputEqualsFalse = False;
+        continue;
+      }
+    }
+    else {
+      if (ended && s->modus == BZ_MODUS_FINISHING && !mt->trailerDone) {
+        s->zbits         = mt->edge;
+        s->numZ          = 0;
+        s->state_out_pos = 0;
+        BZ2_compressStreamTrailer ( s );
+        mt->trailerDone = True;
+        s->statusInputEqualsTrueVsOutputEqualsFalse = False;
+        continue;
+      }
+    }
+    break;
+  }
+  
+  return progress_in || progress_out;
+}
+
+
+/*---------------------------------------------------*/
+static void free_mt_state ( bz_stream* strm, MTState* mt ) {
+  if (mt->pool != NULL) {
+    /* laufende Aufträge dürfen ihre Puffer nicht verlieren */
+    for (Int32 i = 0; i < mt->count; i++) {
+      BZ2_poolWait ( mt->pool, &mt->jobs[(mt->head + i) % mt->nJobs].task );
+    }
+    BZ2_poolDestroy ( mt->pool );
+  }
+  if (mt->jobs != NULL) {
+    for (Int32 i = 0; i < mt->nJobs; i++) {
+      EState* js = mt->jobs[i].es;
+      if (js == NULL) {
+        continue;
+      }
+      if (js->arr1 != NULL) {
+        BZFREE(js->arr1);
+      }
+      if (js->arr2 != NULL) {
+        BZFREE(js->arr2);
+      }
+      if (js->ftab != NULL) {
+        BZFREE(js->ftab);
+      }
+      BZFREE(js);
+    }
+    BZFREE(mt->jobs);
+  }
+  BZFREE(mt);
+}
+
+
+/*---------------------------------------------------*/
+/**
+ * @brief Wie `BZ2_bzCompressInit`, komprimiert aber bis zu `nThreads`
+ * Blöcke gleichzeitig.
+ *
+ * Die Ausgabe ist Byte für Byte identisch zur sequentiellen Kompression.
+ * Pro Thread wird ein zusätzlicher Satz Blockpuffer belegt. Mit
+ * `nThreads` 0 oder 1 verhält sich die Funktion wie `BZ2_bzCompressInit`.
+ */
+int BZ2_bzCompressInitMT ( bz_stream* strm, int blockSize100k, int workFactor, int nThreads ) {
+  Int32    ret;
+  Int32    n;
+  EState*  s;
+  MTState* mt;
+  
+  if (nThreads < 0 || nThreads > BZ_MAX_THREADS) {
+    return BZ_PARAM_ERROR;
+  }
+  ret = BZ2_bzCompressInit ( strm, blockSize100k, workFactor );
+  if (ret != BZ_OK || nThreads <= 1) {
+    return ret;
+  }
+  s = strm->state;
+  n = 100000 * blockSize100k;
+  
+  mt = BZALLOC( sizeof(MTState) );
+  if (mt == NULL) {
+    BZ2_bzCompressEnd ( strm );
+    return BZ_MEM_ERROR;
+  }
+  mt->pool        = NULL;
+  mt->nJobs       = nThreads + 1;
+  mt->head        = 0;
+  mt->count       = 0;
+  mt->emitting    = False;
+  mt->trailerDone = False;
+  mt->jobs        = BZALLOC( mt->nJobs * sizeof(MTJob) );
+  s->mt           = mt;
+  if (mt->jobs == NULL) {
+    BZ2_bzCompressEnd ( strm );
+    return BZ_MEM_ERROR;
+  }
+  for (Int32 i = 0; i < mt->nJobs; i++) {
+    mt->jobs[i].es = NULL;
+  }
+  for (Int32 i = 0; i < mt->nJobs; i++) {
+    EState* js = BZALLOC( sizeof(EState) );
+    mt->jobs[i].es       = js;
+    mt->jobs[i].task.run = mt_compress_job;
+    mt->jobs[i].task.arg = &mt->jobs[i];
+    if (js == NULL) {
+      BZ2_bzCompressEnd ( strm );
+      return BZ_MEM_ERROR;
+    }
+    js->strm     = NULL;
+    js->mt       = NULL;
+    js->sortPool = NULL;
+    js->sortHist = NULL;
+    memset ( &js->sortStats, 0, sizeof(js->sortStats) );
+    js->arr1 = BZALLOC( n                  * sizeof(UInt32) );
+    js->arr2 = BZALLOC( (n+BZ_N_OVERSHOOT) * sizeof(UInt32) );
+    js->ftab = BZALLOC( 65537              * sizeof(UInt32) );
+    if (js->arr1 == NULL || js->arr2 == NULL || js->ftab == NULL) {
+      BZ2_bzCompressEnd ( strm );
+      return BZ_MEM_ERROR;
+    }
+    js->blockSize100k = blockSize100k;
+    set_block_aliases ( js );
+  }
+  mt->pool = BZ2_poolCreate ( nThreads );
+  if (mt->pool == NULL) {
+    BZ2_bzCompressEnd ( strm );
+    return BZ_MEM_ERROR;
+  }
+  
+  /*-- Der Stream-Kopf geht als erstes hinaus. --*/
+  s->zbits = mt->edge;
+  BZ2_bsInitWrite ( s );
+  BZ2_compressStreamHeader ( s );
+  s->statusInputEqualsTrueVsOutputEqualsFalse = False;
+  return BZ_OK;
+}
+
+
 /*---------------------------------------------------*/
 // Diese Funktion wird nur von "int BZ2_bzCompress ( bz_stream *strm, int action )" aufgerufen
 static inline Bool handle_compress ( bz_stream* strm ) {
@@ -376,6 +710,10 @@ static inline Bool handle_compress ( bz_stream* strm ) {
   Bool progress_out = False;
   EState* s = strm->state;
   
+  if (s->mt != NULL) {
+    return handle_compress_mt ( strm );
+  }
+  
   while (True) {
     if (!s->statusInputEqualsTrueVsOutputEqualsFalse) {
       progress_out |= copy_output_until_stop (s);
@@ -417,6 +755,141 @@ static inline Bool handle_compress ( bz_stream* strm ) {
 }
 
 
+/*---------------------------------------------------*/
+/**
+ * @brief Setzt eine Einstellung der Kompression.
+ *
+ * Die Einstellung gilt ab dem nächsten sortierten Block und darf
+ * jederzeit zwischen zwei Aufrufen von `BZ2_bzCompress` geändert werden.
+ * `BZ_OPT_SORT_ALGORITHM` wählt das Sortierverfahren der BWT:
+ * `BZ_SORT_AUTO` (Voreinstellung) nutzt die Hauptsortierung und weicht
+ * bei zu repetitiven Blöcken auf das lineare SA-IS statt auf die
+ * Ausweichsortierung aus; eine kurze Vorab-Schätzung erkennt solche
+ * Blöcke meist schon vor dem ersten Versuch, `BZ_SORT_MAIN` entspricht dem bisherigen
+ * Verhalten, `BZ_SORT_SAIS` sortiert jeden nicht periodischen Block in
+ * linearer Zeit. Alle Verfahren erzeugen denselben Datenstrom.
+ *
+ * `BZ_OPT_TABLE_TOLERANCE` (0 bis 1000, Voreinstellung 0) beendet die
+ * Verfeinerung der Huffman-Tabellen, sobald eine Runde die geschätzten
+ * Kosten um weniger als so viele Promille senkt. Das spart Zeit auf
+ * Kosten der Kompressionsrate. Mit 0 endet sie nur, wenn sich die
+ * Tabellenwahl nicht mehr ändert; der Datenstrom bleibt dann
+ * unverändert.
+ *
+ * `BZ_OPT_SORT_THREADS` (0 bis `BZ_MAX_THREADS`, Voreinstellung 0)
+ * verteilt das Sortieren eines einzelnen Blocks auf so viele Threads,
+ * der aufrufende eingeschlossen. Das verkürzt die Zeit pro Block, wenn
+ * ein Datenstrom nicht in viele Blöcke aufgeteilt werden kann. Im
+ * Mehrthread-Modus von `BZ2_bzCompressInitMT` laufen bereits ganze
+ * Blöcke parallel; dort wird ein Wert größer 1 mit `BZ_PARAM_ERROR`
+ * abgelehnt. Der Datenstrom bleibt unverändert.
+ *
+ * `BZ_OPT_SORT_LAYOUT` legt fest, wie die Hauptsortierung Block und
+ * Quadranten im Speicher hält: `BZ_LAYOUT_SPLIT` (Voreinstellung) in
+ * zwei getrennten Feldern, `BZ_LAYOUT_PACKED` verschränkt in einem
+ * 32-Bit-Wort pro Position, so dass ein Vergleich beide mit einer
+ * Cache-Zeile liest. Welche Anordnung schneller ist, hängt von den
+ * Daten und der Cache-Hierarchie ab; `tests/sortbench.c` misst beide.
+ * Der Datenstrom bleibt unverändert.
+ *
+ * @return `BZ_OK`, `BZ_PARAM_ERROR` oder `BZ_MEM_ERROR`, wenn die
+ *         Threads nicht gestartet werden konnten
+ */
+int BZ2_bzCompressSetOption ( bz_stream* strm, int option, int value ) {
+  EState* s;
+  Int32   n;
+  
+  if (strm == NULL) {
+    return BZ_PARAM_ERROR;
+  }
+  s = strm->state;
+  if (s == NULL || s->strm != strm) {
+    return BZ_PARAM_ERROR;
+  }
+  
+  if (option == BZ_OPT_SORT_ALGORITHM) {
+    if (value < BZ_SORT_AUTO || value > BZ_SORT_SAIS) {
+      return BZ_PARAM_ERROR;
+    }
+    s->sortAlgorithm = value;
+    return BZ_OK;
+  }
+  if (option == BZ_OPT_SORT_LAYOUT) {
+    if (value < BZ_LAYOUT_SPLIT || value > BZ_LAYOUT_PACKED) {
+      return BZ_PARAM_ERROR;
+    }
+    s->sortLayout = value;
+    return BZ_OK;
+  }
+  if (option == BZ_OPT_TABLE_TOLERANCE) {
+    if (value < 0 || value > 1000) {
+      return BZ_PARAM_ERROR;
+    }
+    s->tableTolerance = value;
+    return BZ_OK;
+  }
+  if (option == BZ_OPT_SORT_THREADS) {
+    if (value < 0 || value > BZ_MAX_THREADS) {
+      return BZ_PARAM_ERROR;
+    }
+    /* die Blöcke eines MT-Stroms sortieren ohne Pool */
+    if (s->mt != NULL && value > 1) {
+      return BZ_PARAM_ERROR;
+    }
+    if (s->sortPool != NULL) {
+      BZ2_poolDestroy ( s->sortPool );
+      s->sortPool = NULL;
+    }
+    if (s->sortHist != NULL) {
+      BZFREE(s->sortHist);
+      s->sortHist = NULL;
+    }
+    /* der aufrufende Thread sortiert selbst mit */
+    if (value > 1) {
+      s->sortPool = BZ2_poolCreate ( value - 1 );
+      if (s->sortPool == NULL) {
+        return BZ_MEM_ERROR;
+      }
+      /* je ein Histogramm pro Thread der ersten Radix-Sortierung;
+         fehlt es, läuft nur diese Phase allein */
+      n = (value < BZ_SORT_HIST_MAX) ? value : BZ_SORT_HIST_MAX;
+      s->sortHist = BZALLOC( n * 65536 * sizeof(UInt32) );
+    }
+    return BZ_OK;
+  }
+  return BZ_PARAM_ERROR;
+}
+
+
+/*---------------------------------------------------*/
+/**
+ * @brief Meldet, mit welchem Verfahren die Blöcke sortiert wurden.
+ *
+ * Gezählt werden alle seit `BZ2_bzCompressInit` oder
+ * `BZ2_bzCompressReset` sortierten Blöcke. Mit `BZ_SORT_AUTO` schätzt
+ * eine kurze Vorab-Analyse, wie repetitiv ein Block ist; verspricht sie,
+ * dass die Hauptsortierung ihr Budget aufbraucht, geht der Block gleich
+ * an SA-IS und zählt zusätzlich unter `probed`. `abandoned` zählt die
+ * Blöcke, bei denen die Hauptsortierung trotzdem abbrechen musste. Im
+ * Mehrthread-Modus erscheint ein Block erst, wenn er ausgegeben ist.
+ *
+ * @return `BZ_OK` oder `BZ_PARAM_ERROR`
+ */
+int BZ2_bzCompressGetSortStats ( bz_stream* strm, bz_sort_stats* stats ) {
+  EState* s;
+  
+  if (strm == NULL || stats == NULL) {
+    return BZ_PARAM_ERROR;
+  }
+  s = strm->state;
+  if (s == NULL || s->strm != strm) {
+    return BZ_PARAM_ERROR;
+  }
+  *stats = s->sortStats;
+  return BZ_OK;
+}
+
+
 /*---------------------------------------------------*/
 int BZ2_bzCompress ( bz_stream *strm, int action ) {
   Bool progress;
@@ -479,7 +952,7 @@ int BZ2_bzCompress ( bz_stream *strm, int action ) {
         }
         progress = handle_compress ( strm );
         if (statusOfStrm->avail_in_expect > 0 || !isempty_RL(statusOfStrm) ||
-            statusOfStrm->state_out_pos < statusOfStrm->numZ) {
+            pending_output(statusOfStrm)) {
           return BZ_FLUSH_OK;
         }
         statusOfStrm->modus = BZ_MODUS_RUNNING;
@@ -497,7 +970,7 @@ int BZ2_bzCompress ( bz_stream *strm, int action ) {
           return BZ_SEQUENCE_ERROR;
         }
         if (statusOfStrm->avail_in_expect > 0 || !isempty_RL(statusOfStrm) ||
-            statusOfStrm->state_out_pos < statusOfStrm->numZ) {
+            pending_output(statusOfStrm)) {
           return BZ_FINISH_OK;
         }
         statusOfStrm->modus = BZ_MODUS_IDLE;
@@ -536,6 +1009,17 @@ int BZ2_bzCompressEnd  ( bz_stream *strm ) {
     }
   }
   
+  // Im Mehrthread-Modus zuerst die Aufträge und ihre Puffer freigeben
+  if (s->mt != NULL) {
+    free_mt_state ( strm, s->mt );
+  }
+  // Threads für das Sortieren eines Blocks beenden
+  if (s->sortPool != NULL) {
+    BZ2_poolDestroy ( s->sortPool );
+  }
+  if (s->sortHist != NULL) {
+    BZFREE(s->sortHist);
+  }
   // Wenn das Array Nr. 1 nicht NULL ist
   if (s->arr1 != NULL) {
     // Rufe die Funktion BZFree auf und übergebe das Array Nr. 1
@@ -561,6 +1045,281 @@ int BZ2_bzCompressEnd  ( bz_stream *strm ) {
 }
 
 
+/*---------------------------------------------------*/
+/**
+ * @brief Setzt einen Kompressionsstrom für einen neuen Datenstrom zurück.
+ *
+ * Wirkt wie `BZ2_bzCompressEnd` gefolgt von `BZ2_bzCompressInit` mit
+ * denselben Parametern, behält aber `arr1`, `arr2` und `ftab` und im
+ * Mehrthread-Modus auch die Threads und deren Puffer. Blockgröße,
+ * `workFactor` und die mit `BZ2_bzCompressSetOption` gewählten
+ * Einstellungen bleiben erhalten. Der Aufruf ist in jedem Zustand
+ * erlaubt; ein noch nicht fertiger Strom wird verworfen.
+ *
+ * @return `BZ_OK` oder `BZ_PARAM_ERROR`
+ */
+int BZ2_bzCompressReset ( bz_stream* strm ) {
+  EState*  s;
+  MTState* mt;
+  
+  if (strm == NULL) {
+    return BZ_PARAM_ERROR;
+  }
+  s = strm->state;
+  if (s == NULL || s->strm != strm) {
+    return BZ_PARAM_ERROR;
+  }
+  mt = s->mt;
+  
+  if (mt != NULL) {
+    /* laufende Aufträge arbeiten noch auf ihren Puffern */
+    for (Int32 i = 0; i < mt->count; i++) {
+      BZ2_poolWait ( mt->pool, &mt->jobs[(mt->head + i) % mt->nJobs].task );
+    }
+    for (Int32 i = 0; i < mt->nJobs; i++) {
+      memset ( &mt->jobs[i].es->sortStats, 0, sizeof(bz_sort_stats) );
+    }
+    mt->head        = 0;
+    mt->count       = 0;
+    mt->emitting    = False;
+    mt->trailerDone = False;
+  }
+  
+  s->blockNo           = 0;
+  s->statusInputEqualsTrueVsOutputEqualsFalse = True;
+  s->modus             = BZ_MODUS_RUNNING;
+  s->avail_in_expect   = 0;
+  s->combinedCRC       = 0;
+  set_block_aliases ( s );
+  s->zbits             = NULL;
+  memset ( &s->sortStats, 0, sizeof(s->sortStats) );
+  
+  strm->total_in_lo32  = 0;
+  strm->total_in_hi32  = 0;
+  strm->total_out_lo32 = 0;
+  strm->total_out_hi32 = 0;
+  init_RL ( s );
+  prepare_new_block ( s );
+  
+  if (mt != NULL) {
+    s->zbits = mt->edge;
+    BZ2_bsInitWrite ( s );
+    BZ2_compressStreamHeader ( s );
+    s->statusInputEqualsTrueVsOutputEqualsFalse = False;
+  }
+  return BZ_OK;
+}
+
+
+/*---------------------------------------------------*/
+/*--- Independently compressed blocks             ---*/
+/*---------------------------------------------------*/
+
+/*--
+   Ein bzip2-Strom besteht aus Kopf, Blöcken und Ende. Die Blöcke
+   hängen nur über die Gesamt-CRC im Ende voneinander ab, und diese
+   entsteht, indem die Block-CRCs der Reihe nach eingefaltet werden:
+   combined = rotl(combined, 1) ^ blockCRC. Blöcke können daher
+   getrennt komprimiert und später zu einem Strom zusammengesetzt
+   werden; sie sind allerdings nicht bytegrenzenausgerichtet.
+--*/
+
+/*---------------------------------------------------*/
+/**
+ * @brief Fasst die CRCs zweier aufeinanderfolgender Blockfolgen zusammen.
+ *
+ * Ist `crc1` die Gesamt-CRC einer ersten und `crc2` die einer zweiten
+ * Folge aus `nBlocks2` Blöcken, ist das Ergebnis die Gesamt-CRC beider
+ * Folgen hintereinander. Mit `nBlocks2 == 1` und einer Block-CRC als
+ * `crc2` ist das genau ein Schritt des Einfaltens; Teilergebnisse
+ * mehrerer Knoten lassen sich so in beliebiger Gruppierung vereinen.
+ *
+ * @param crc1     Gesamt-CRC der vorderen Blöcke (0 für keine).
+ * @param crc2     Gesamt-CRC der hinteren Blöcke.
+ * @param nBlocks2 Anzahl der hinteren Blöcke, nicht negativ.
+ */
+unsigned int BZ2_bzCombineCRC ( unsigned int crc1, unsigned int crc2, int nBlocks2 ) {
+  UInt32 r = (UInt32)nBlocks2 & 31;
+  
+  if (r != 0) {
+    crc1 = (crc1 << r) | (crc1 >> (32 - r));
+  }
+  return crc1 ^ crc2;
+}
+
+
+/*---------------------------------------------------*/
+/**
+ * @brief Komprimiert einen einzelnen Block ohne Strom-Kopf und -Ende.
+ *
+ * Es wird so viel von `source` gelesen, wie in einen Block der Größe
+ * `blockSize100k` passt. Das Ergebnis beginnt mit der Block-Kennung und
+ * ist `*nBits` Bits lang; die Füllbits des letzten Bytes sind 0. Mit
+ * `BZ2_bzStitchBlocks` werden solche Blöcke zu einem Strom verbunden.
+ *
+ * @param dest          Ziel für den Bitstrom des Blocks.
+ * @param destLen       Ein: Größe von `dest`; Aus: belegte Bytes.
+ * @param nBits         Aus: Länge des Blocks in Bits.
+ * @param source        Die zu komprimierenden Daten.
+ * @param sourceLen     Ein: verfügbare Bytes (> 0); Aus: gelesene Bytes.
+ * @param blockSize100k Blockgröße 1..9, höchstens die des Zielstroms.
+ * @param workFactor    wie bei `BZ2_bzCompressInit`.
+ * @param blockCRC      Aus: CRC des Blocks.
+ * @return `BZ_OK`, `BZ_PARAM_ERROR`, `BZ_MEM_ERROR` oder `BZ_OUTBUFF_FULL`
+ */
+int BZ2_bzCompressBlock ( char* dest, unsigned int* destLen, unsigned int* nBits, char* source, unsigned int* sourceLen, int blockSize100k, int workFactor, unsigned int* blockCRC ) {
+  bz_stream strm;
+  EState*   s;
+  Int32     bits;
+  UInt32    bytes;
+  int       ret;
+  
+  if (dest == NULL || destLen == NULL || nBits == NULL || source == NULL || sourceLen == NULL || *sourceLen == 0 || blockCRC == NULL) {
+    return BZ_PARAM_ERROR;
+  }
+  
+  strm.bzalloc = NULL;
+  strm.bzfree  = NULL;
+  strm.opaque  = NULL;
+  ret = BZ2_bzCompressInitSized ( &strm, blockSize100k, workFactor, *sourceLen );
+  if (ret != BZ_OK) {
+    return ret;
+  }
+  s = strm.state;
+  
+  strm.next_in  = source;
+  strm.avail_in = *sourceLen;
+  copy_input_until_stop ( s );
+  /*-- nblockMAX lässt Platz für den noch offenen Lauf --*/
+  flush_RL ( s );
+  BZ_FINALISE_CRC ( &s->blockCRC );
+  
+  bits  = BZ2_compressBlockBits ( s );
+  bytes = (UInt32)(bits + 7) / 8;
+  if (bytes > *destLen) {
+    BZ2_bzCompressEnd ( &strm );
+    return BZ_OUTBUFF_FULL;
+  }
+  memcpy ( dest, s->zbits, bytes );
+  
+  *destLen    = bytes;
+  *nBits      = (unsigned int)bits;
+  *sourceLen -= strm.avail_in;
+  *blockCRC   = s->blockCRC;
+  BZ2_bzCompressEnd ( &strm );
+  return BZ_OK;
+}
+
+
+/*---------------------------------------------------*/
+/*--
+   Hängt nBits Bits aus src an dest ab Bitposition *bitPos an.
+   Die noch freien Bits des Bytes an *bitPos müssen 0 sein; das
+   gilt danach wieder für das neue Ende.
+--*/
+static void stitch_bits ( UChar* dest, UInt64* bitPos, const UChar* src, UInt32 nBits ) {
+  UInt32 shift  = (UInt32)(*bitPos & 7);
+  UChar* d      = dest + (*bitPos >> 3);
+  UInt32 nBytes = nBits / 8;
+  UInt32 rest   = nBits % 8;
+  UInt32 i;
+  UChar  last;
+  
+  if (shift == 0) {
+    memcpy ( d, src, nBytes );
+  }
+  else {
+    for (i = 0; i < nBytes; i++) {
+      d[i]   |= (UChar)(src[i] >> shift);
+      d[i+1]  = (UChar)(src[i] << (8 - shift));
+    }
+  }
+  if (rest > 0) {
+    last = (UChar)(src[nBytes] & (0xff << (8 - rest)));
+    if (shift == 0) {
+      d[nBytes] = last;
+    }
+    else {
+      d[nBytes] |= (UChar)(last >> shift);
+      if (shift + rest > 8) {
+        d[nBytes+1] = (UChar)(last << (8 - shift));
+      }
+    }
+  }
+  *bitPos += nBits;
+}
+
+
+/*---------------------------------------------------*/
+/**
+ * @brief Setzt getrennt komprimierte Blöcke zu einem bzip2-Strom zusammen.
+ *
+ * Schreibt Kopf, die Blöcke in der gegebenen Reihenfolge und das Ende
+ * mit der aus `blockCRCs` gebildeten Gesamt-CRC. Kein Block darf mit
+ * einer größeren Blockgröße als `blockSize100k` komprimiert worden sein.
+ *
+ * @param dest          Ziel für den Strom.
+ * @param destLen       Ein: Größe von `dest`; Aus: Länge des Stroms.
+ * @param blockSize100k Blockgröße für den Kopf, 1..9.
+ * @param nBlocks       Anzahl der Blöcke, 0 ergibt einen leeren Strom.
+ * @param blocks        die Blöcke aus `BZ2_bzCompressBlock`.
+ * @param blockBits     deren Länge in Bits.
+ * @param blockCRCs     deren CRCs.
+ * @return `BZ_OK`, `BZ_PARAM_ERROR` oder `BZ_OUTBUFF_FULL`
+ */
+int BZ2_bzStitchBlocks ( char* dest, unsigned int* destLen, int blockSize100k, int nBlocks, char** blocks, unsigned int* blockBits, unsigned int* blockCRCs ) {
+  UChar  head[4];
+  UChar  tail[10];
+  UInt64 total;
+  UInt64 bitPos;
+  UInt32 combinedCRC;
+  Int32  i;
+  
+  if (dest == NULL || destLen == NULL || blockSize100k < 1 || blockSize100k > 9 || nBlocks < 0) {
+    return BZ_PARAM_ERROR;
+  }
+  if (nBlocks > 0 && (blocks == NULL || blockBits == NULL || blockCRCs == NULL)) {
+    return BZ_PARAM_ERROR;
+  }
+  
+  total = 32 + 80;
+  for (i = 0; i < nBlocks; i++) {
+    total += blockBits[i];
+  }
+  if ((total + 7) / 8 > *destLen) {
+    return BZ_OUTBUFF_FULL;
+  }
+  
+  head[0] = BZ_HDR_B;
+  head[1] = BZ_HDR_Z;
+  head[2] = BZ_HDR_h;
+  head[3] = (UChar)(BZ_HDR_0 + blockSize100k);
+  bitPos = 0;
+  stitch_bits ( (UChar*)dest, &bitPos, head, 32 );
+  
+  combinedCRC = 0;
+  for (i = 0; i < nBlocks; i++) {
+    stitch_bits ( (UChar*)dest, &bitPos, (UChar*)blocks[i], blockBits[i] );
+    combinedCRC = BZ2_bzCombineCRC ( combinedCRC, blockCRCs[i], 1 );
+  }
+  
+  tail[0] = 0x17;
+  tail[1] = 0x72;
+  tail[2] = 0x45;
+  tail[3] = 0x38;
+  tail[4] = 0x50;
+  tail[5] = 0x90;
+  tail[6] = (UChar)(combinedCRC >> 24);
+  tail[7] = (UChar)(combinedCRC >> 16);
+  tail[8] = (UChar)(combinedCRC >> 8);
+  tail[9] = (UChar)(combinedCRC);
+  stitch_bits ( (UChar*)dest, &bitPos, tail, 80 );
+  
+  *destLen = (unsigned int)((bitPos + 7) / 8);
+  return BZ_OK;
+}
+
+
 /*---------------------------------------------------*/
 /*--- Decompression stuff                         ---*/
 /*---------------------------------------------------*/
@@ -605,11 +1364,82 @@ int BZ2_bzDecompressInit ( bz_stream* strm, int small ) {
   s->ll4                   = NULL;
   s->ll16                  = NULL;
   s->tt                    = NULL;
+  s->ttBlockSize100k       = 0;
+  s->lf                    = NULL;
+  s->bwtBlock              = NULL;
+  s->bwtBlockSize100k      = 0;
+  s->bwtDecoded            = False;
   s->currBlockNo           = 0;
+  s->singleBlock           = False;
   
   return BZ_OK;
 }
 
+
+/*---------------------------------------------------*/
+/**
+ * @brief Setzt einen Dekompressionsstrom direkt auf einen Blockanfang.
+ *
+ * `strm->next_in` zeigt auf das Byte, das das erste Bit der Block-Magic
+ * enthält, `bitOffset` (0..7) ist dessen Position darin. Anschließend
+ * dekodiert `BZ2_bzDecompress` genau diesen Block, prüft seinen CRC und
+ * endet mit `BZ_STREAM_END`. Das Blockende liegt dann bei Bit
+ * `8 * (verbrauchte Bytes) - s->bsLive`.
+ *
+ * @param strm          mit `BZ2_bzDecompressInit` initialisierter Strom.
+ * @param blockSize100k Blockgröße aus dem Kopf des Streams.
+ * @param bitOffset     Bitposition im ersten Byte.
+ */
+Int32 BZ2_decompressEnterBlock ( bz_stream* strm, Int32 blockSize100k, Int32 bitOffset ) {
+  DState* s;
+  
+  if (strm == NULL || strm->state == NULL || strm->avail_in == 0) {
+    return BZ_PARAM_ERROR;
+  }
+  if (blockSize100k < 1 || blockSize100k > 9 || bitOffset < 0 || bitOffset > 7) {
+    return BZ_PARAM_ERROR;
+  }
+  s = strm->state;
+  
+  if (s->ttBlockSize100k != blockSize100k || (s->tt == NULL && s->ll16 == NULL)) {
+    if (s->tt != NULL) {
+      BZFREE(s->tt);
+    }
+    if (s->ll16 != NULL) {
+      BZFREE(s->ll16);
+    }
+    if (s->ll4 != NULL) {
+      BZFREE(s->ll4);
+    }
+    s->tt   = NULL;
+    s->ll16 = NULL;
+    s->ll4  = NULL;
+    if (s->smallDecompress) {
+      s->ll16 = BZALLOC( blockSize100k * 100000 * sizeof(UInt16) );
+      s->ll4  = BZALLOC( ((1 + blockSize100k * 100000) >> 1) * sizeof(UChar) );
+      if (s->ll16 == NULL || s->ll4 == NULL) {
+        return BZ_MEM_ERROR;
+      }
+    }
+    else {
+      s->tt = BZALLOC( blockSize100k * 100000 * sizeof(Int32) );
+      if (s->tt == NULL) {
+        return BZ_MEM_ERROR;
+      }
+    }
+    s->ttBlockSize100k = blockSize100k;
+  }
+  
+  s->blockSize100k = blockSize100k;
+  s->singleBlock   = True;
+  s->state         = BZ_X_BLKHDR_1;
+  s->bsBuff        = *((UChar*)(strm->next_in)) & (0xff >> bitOffset);
+  s->bsLive        = 8 - bitOffset;
+  strm->next_in  += 1;
+  strm->avail_in -= 1;
+  return BZ_OK;
+}
+
 /*---------------------------------------------------*/
 /* Return  True if data corruption is discovered.
    Returns False if there is no problem.
@@ -629,7 +1459,6 @@ static Bool unRLE_obuf_to_output_FAST ( DState* s ) {
           break;
         }
         *( (UChar*)(s->strm->next_out) ) = s->state_out_ch;
-        BZ_UPDATE_CRC(&s->calculatedBlockCRC, s->state_out_ch);
         s->state_out_len -= 1;
         s->strm->next_out += 1;
         s->strm->avail_out -= 1;
@@ -704,13 +1533,13 @@ static Bool unRLE_obuf_to_output_FAST ( DState* s ) {
   else {
     
     /* restore */
-    UInt32        c_calculatedBlockCRC = s->calculatedBlockCRC;
     UChar         c_state_out_ch       = s->state_out_ch;
     Int32         c_state_out_len      = s->state_out_len;
     Int32         c_nblock_used        = s->nblock_used;
     Int32         c_k0                 = s->k0;
     UInt32*       c_tt                 = s->tt;
     UInt32        c_tPos               = s->tPos;
+    const UChar*  c_block              = s->bwtDecoded ? s->bwtBlock : NULL;
     char*         cs_next_out          = s->strm->next_out;
     unsigned int  cs_avail_out         = s->strm->avail_out;
     Int32         ro_blockSize100k     = s->blockSize100k;
@@ -732,7 +1561,6 @@ static Bool unRLE_obuf_to_output_FAST ( DState* s ) {
             break;
           }
           *( (UChar*)(cs_next_out) ) = c_state_out_ch;
-          BZ_UPDATE_CRC(&c_calculatedBlockCRC, c_state_out_ch); // Funktionsaufruf (Pointer)
           c_state_out_len -= 1;
           cs_next_out += 1;
           cs_avail_out -= 1;
@@ -743,7 +1571,6 @@ static Bool unRLE_obuf_to_output_FAST ( DState* s ) {
             goto return_notr;
           }
           *( (UChar*)(cs_next_out) ) = c_state_out_ch;
-          BZ_UPDATE_CRC(&c_calculatedBlockCRC, c_state_out_ch); // Funktionsaufruf (Pointer)
           cs_next_out += 1;
           cs_avail_out -= 1;
         }
@@ -759,7 +1586,7 @@ static Bool unRLE_obuf_to_output_FAST ( DState* s ) {
         goto return_notr;
       }
       c_state_out_ch = c_k0;
-      BZ_GET_FAST_C(k1);
+      BZ_GET_NEXT_C(k1);
       c_nblock_used += 1;
       if (k1 != c_k0) {
         c_k0 = k1;
@@ -769,7 +1596,7 @@ static Bool unRLE_obuf_to_output_FAST ( DState* s ) {
         goto s_state_out_len_eq_one;
       
       c_state_out_len = 2;
-      BZ_GET_FAST_C(k1);
+      BZ_GET_NEXT_C(k1);
       c_nblock_used += 1;
       if (c_nblock_used == s_save_nblockPP) {
         continue;
@@ -780,7 +1607,7 @@ static Bool unRLE_obuf_to_output_FAST ( DState* s ) {
       }
       
       c_state_out_len = 3;
-      BZ_GET_FAST_C(k1);
+      BZ_GET_NEXT_C(k1);
       c_nblock_used += 1;
       if (c_nblock_used == s_save_nblockPP) {
         continue;
@@ -790,10 +1617,10 @@ static Bool unRLE_obuf_to_output_FAST ( DState* s ) {
         continue;
       }
       
-      BZ_GET_FAST_C(k1);
+      BZ_GET_NEXT_C(k1);
       c_nblock_used += 1;
       c_state_out_len = ((Int32)k1) + 4;
-      BZ_GET_FAST_C(c_k0);
+      BZ_GET_NEXT_C(c_k0);
       c_nblock_used += 1;
     }
     
@@ -805,7 +1632,6 @@ static Bool unRLE_obuf_to_output_FAST ( DState* s ) {
     }
     
     /* save */
-    s->calculatedBlockCRC = c_calculatedBlockCRC;
     s->state_out_ch       = c_state_out_ch;
     s->state_out_len      = c_state_out_len;
     s->nblock_used        = c_nblock_used;
@@ -857,7 +1683,6 @@ static Bool unRLE_obuf_to_output_SMALL ( DState* s ) {
           break;
         }
         *( (UChar*)(s->strm->next_out) ) = s->state_out_ch;
-        BZ_UPDATE_CRC(&s->calculatedBlockCRC, s->state_out_ch); // Funktionsaufruf (Pointer)
         s->state_out_len -= 1;
         s->strm->next_out += 1;
         s->strm->avail_out -= 1;
@@ -940,7 +1765,6 @@ static Bool unRLE_obuf_to_output_SMALL ( DState* s ) {
           break;
         }
         *( (UChar*)(s->strm->next_out) ) = s->state_out_ch;
-        BZ_UPDATE_CRC(&s->calculatedBlockCRC, s->state_out_ch); // Funktionsaufruf (Pointer)
         s->state_out_len -= 1;
         s->strm->next_out += 1;
         s->strm->avail_out -= 1;
@@ -1023,6 +1847,8 @@ int BZ2_bzDecompress ( bz_stream *strm ) {
       return BZ_SEQUENCE_ERROR;
     }
     if (s->state == BZ_X_OUTPUT) {
+      /*-- the block CRC is run over the new output in one go --*/
+      UChar* outStart = (UChar*)strm->next_out;
       if (s->smallDecompress) {
         corrupt = unRLE_obuf_to_output_SMALL ( s );
       }
@@ -1032,6 +1858,7 @@ int BZ2_bzDecompress ( bz_stream *strm ) {
       if (corrupt) {
         return BZ_DATA_ERROR;
       }
+      s->calculatedBlockCRC = BZ2_crcUpdate ( s->calculatedBlockCRC, outStart, (UInt32)((UChar*)strm->next_out - outStart) );
       if (s->nblock_used == s->save_nblock+1 && s->state_out_len == 0) {
         BZ_FINALISE_CRC ( &s->calculatedBlockCRC );
         if (s->calculatedBlockCRC != s->storedBlockCRC) {
@@ -1040,6 +1867,9 @@ int BZ2_bzDecompress ( bz_stream *strm ) {
         s->calculatedCombinedCRC = (s->calculatedCombinedCRC << 1) | (s->calculatedCombinedCRC >> 31);
         s->calculatedCombinedCRC ^= s->calculatedBlockCRC;
         s->state = BZ_X_BLKHDR_1;
+        if (s->singleBlock) {
+          return BZ_STREAM_END;
+        }
       }
       else {
         return BZ_OK;
@@ -1079,6 +1909,12 @@ int BZ2_bzDecompressEnd ( bz_stream *strm ) {
   if (s->tt   != NULL) {
     BZFREE(s->tt);
   }
+  if (s->lf   != NULL) {
+    BZFREE(s->lf);
+  }
+  if (s->bwtBlock != NULL) {
+    BZFREE(s->bwtBlock);
+  }
   if (s->ll16 != NULL) {
     BZFREE(s->ll16);
   }
@@ -1092,6 +1928,44 @@ int BZ2_bzDecompressEnd ( bz_stream *strm ) {
   return BZ_OK;
 }
 
+
+/*---------------------------------------------------*/
+/**
+ * @brief Setzt einen Dekompressionsstrom für einen neuen Datenstrom zurück.
+ *
+ * Wirkt wie `BZ2_bzDecompressEnd` gefolgt von `BZ2_bzDecompressInit`
+ * mit demselben `small`, behält aber die Puffer für die Rücktransformation
+ * (`tt` bzw. `ll16`/`ll4` sowie `lf`/`bwtBlock`). Sie werden beim
+ * nächsten Strom wiederverwendet, wenn dessen Blockgröße gleich ist.
+ *
+ * @return `BZ_OK` oder `BZ_PARAM_ERROR`
+ */
+int BZ2_bzDecompressReset ( bz_stream* strm ) {
+  DState* s;
+  
+  if (strm == NULL) {
+    return BZ_PARAM_ERROR;
+  }
+  s = strm->state;
+  if (s == NULL || s->strm != strm) {
+    return BZ_PARAM_ERROR;
+  }
+  
+  s->state                 = BZ_X_MAGIC_1;
+  s->bsLive                = 0;
+  s->bsBuff                = 0;
+  s->calculatedCombinedCRC = 0;
+  strm->total_in_lo32      = 0;
+  strm->total_in_hi32      = 0;
+  strm->total_out_lo32     = 0;
+  strm->total_out_hi32     = 0;
+  s->bwtDecoded            = False;
+  s->currBlockNo           = 0;
+  s->singleBlock           = False;
+  
+  return BZ_OK;
+}
+
 /*---------------------------------------------------*/
 /*--- File I/O stuff                              ---*/
 /*---------------------------------------------------*/
@@ -1104,7 +1978,8 @@ if (bzf != NULL) {bzf->lastErr = eee;}   \
 
 typedef struct {
   FILE*     handle;
-  Char      buf[BUFFER_SIZE];
+  Char*     buf;
+  UInt32    bufSize;
   Int32     bufN;
   Bool      writing;
   bz_stream strm;
@@ -1122,14 +1997,34 @@ static Bool myfeof ( FILE* f ) {
   return False;
 }
 
+/*---------------------------------------------*/
+/*--
+   The handle and its I/O buffer come from one
+   allocation, so a plain free() releases both.
+--*/
+static bzFile* bzfile_alloc ( UInt32 bufSize ) {
+  bzFile* bzf = malloc ( sizeof(bzFile) + (size_t)bufSize );
+  if (bzf == NULL) {
+    return NULL;
+  }
+  bzf->buf     = (Char*)(bzf + 1);
+  bzf->bufSize = bufSize;
+  return bzf;
+}
+
 /*---------------------------------------------------*/
 BZFILE* BZ2_bzWriteOpen ( int* bzerror, FILE* f, int blockSize100k, int workFactor ) {
+  return BZ2_bzWriteOpenBuffered ( bzerror, f, blockSize100k, workFactor, 0 );
+}
+
+/*---------------------------------------------------*/
+BZFILE* BZ2_bzWriteOpenBuffered ( int* bzerror, FILE* f, int blockSize100k, int workFactor, int bufferSize ) {
   Int32   ret;
   bzFile* bzf = NULL;
   
   BZ_SETERR(BZ_OK);
   
-  if (f == NULL || (blockSize100k < 1 || blockSize100k > 9) || (workFactor < 0 || workFactor > 250)) {
+  if (f == NULL || (blockSize100k < 1 || blockSize100k > 9) || (workFactor < 0 || workFactor > 250) || bufferSize < 0) {
     BZ_SETERR(BZ_PARAM_ERROR);
     return NULL;
   }
@@ -1139,7 +2034,10 @@ BZFILE* BZ2_bzWriteOpen ( int* bzerror, FILE* f, int blockSize100k, int workFact
     return NULL;
   }
   
-  bzf = malloc ( sizeof(bzFile) );
+  if (bufferSize == 0) {
+    bufferSize = BZ_IO_BUFFER_SIZE;
+  }
+  bzf = bzfile_alloc ( bufferSize );
   if (bzf == NULL) {
     BZ_SETERR(BZ_MEM_ERROR);
     return NULL;
@@ -1200,7 +2098,7 @@ void BZ2_bzWrite ( int*    bzerror, BZFILE* b, void*   buf, int     len ) {
   bzf->strm.next_in  = buf;
   
   while (True) {
-    bzf->strm.avail_out = BUFFER_SIZE;
+    bzf->strm.avail_out = bzf->bufSize;
     bzf->strm.next_out = bzf->buf;
     ret = BZ2_bzCompress ( &(bzf->strm), BZ_RUN );
     if (ret != BZ_RUN_OK) {
@@ -1208,8 +2106,8 @@ void BZ2_bzWrite ( int*    bzerror, BZFILE* b, void*   buf, int     len ) {
       return;
     }
     
-    if (bzf->strm.avail_out < BUFFER_SIZE) {
-      n = BUFFER_SIZE - bzf->strm.avail_out;
+    if (bzf->strm.avail_out < bzf->bufSize) {
+      n = bzf->bufSize - bzf->strm.avail_out;
       n2 = fwrite ( (void*)(bzf->buf), sizeof(UChar), n, bzf->handle );
       if (n != n2 || ferror(bzf->handle)) {
         BZ_SETERR(BZ_IO_ERROR);
@@ -1264,7 +2162,7 @@ void BZ2_bzWriteClose64 ( int* bzerror, BZFILE* b, int abandon, unsigned int* nb
   
   if ((!abandon) && bzf->lastErr == BZ_OK) {
     while (True) {
-      bzf->strm.avail_out = BUFFER_SIZE;
+      bzf->strm.avail_out = bzf->bufSize;
       bzf->strm.next_out = bzf->buf;
       ret = BZ2_bzCompress ( &(bzf->strm), BZ_FINISH );
       if (ret != BZ_FINISH_OK && ret != BZ_STREAM_END) {
@@ -1272,8 +2170,8 @@ void BZ2_bzWriteClose64 ( int* bzerror, BZFILE* b, int abandon, unsigned int* nb
         return;
       }
       
-      if (bzf->strm.avail_out < BUFFER_SIZE) {
-        n = BUFFER_SIZE - bzf->strm.avail_out;
+      if (bzf->strm.avail_out < bzf->bufSize) {
+        n = bzf->bufSize - bzf->strm.avail_out;
         n2 = fwrite ( (void*)(bzf->buf), sizeof(UChar), n, bzf->handle );
         if (n != n2 || ferror(bzf->handle)) {
           BZ_SETERR(BZ_IO_ERROR);
@@ -1314,16 +2212,29 @@ void BZ2_bzWriteClose64 ( int* bzerror, BZFILE* b, int abandon, unsigned int* nb
 }
 
 /*---------------------------------------------------*/
+/*--
+   Keeps the historic BUFFER_SIZE read buffer, since
+   callers size their unused[] arrays by it.
+--*/
 BZFILE* BZ2_bzReadOpen ( int* bzerror, FILE* f, int small, void* unused, int nUnused ) {
+  return BZ2_bzReadOpenBuffered ( bzerror, f, small, unused, nUnused, BUFFER_SIZE );
+}
+
+/*---------------------------------------------------*/
+BZFILE* BZ2_bzReadOpenBuffered ( int* bzerror, FILE* f, int small, void* unused, int nUnused, int bufferSize ) {
   bzFile* bzf = NULL;
   int     ret;
   
   BZ_SETERR(BZ_OK);
   
+  if (bufferSize == 0) {
+    bufferSize = BZ_IO_BUFFER_SIZE;
+  }
   if (f == NULL ||
       (small != False && small != True) ||
+      bufferSize < 0 ||
       (unused == NULL && nUnused != 0) ||
-      (unused != NULL && (nUnused < 0 || nUnused > BUFFER_SIZE))) {
+      (unused != NULL && (nUnused < 0 || nUnused > bufferSize))) {
     BZ_SETERR(BZ_PARAM_ERROR);
     return NULL;
   }
@@ -1333,7 +2244,7 @@ BZFILE* BZ2_bzReadOpen ( int* bzerror, FILE* f, int small, void* unused, int nUn
     return NULL;
   }
   
-  bzf = malloc ( sizeof(bzFile) );
+  bzf = bzfile_alloc ( bufferSize );
   if (bzf == NULL) {
     BZ_SETERR(BZ_MEM_ERROR);
     return NULL;
@@ -1424,7 +2335,7 @@ int BZ2_bzRead ( int* bzerror, BZFILE* b, void* buf, int len ) {
     };
     
     if (bzf->strm.avail_in == 0 && !myfeof(bzf->handle)) {
-      n = (unsigned int) fread ( bzf->buf, sizeof(UChar), BUFFER_SIZE, bzf->handle );
+      n = (unsigned int) fread ( bzf->buf, sizeof(UChar), bzf->bufSize, bzf->handle );
       if (ferror(bzf->handle)) {
         BZ_SETERR(BZ_IO_ERROR);
         return 0;
@@ -1501,7 +2412,8 @@ int BZ2_bzBuffToBuffCompress (char* dest, unsigned int* destLen, char* source, u
   strm.bzalloc = NULL;
   strm.bzfree = NULL;
   strm.opaque = NULL;
-  ret = BZ2_bzCompressInit ( &strm, blockSize100k, workFactor );
+  /* the whole input is known, so the block buffers need not be larger */
+  ret = BZ2_bzCompressInitSized ( &strm, blockSize100k, workFactor, (sourceLen > 0) ? sourceLen : 1 );
   if (ret != BZ_OK) {
     return ret;
   }
@@ -1640,7 +2552,7 @@ static BZFILE * bzopen_or_bzdopen (const char *path,   /* no use when bzdopen */
     bzip2FilePointer = BZ2_bzWriteOpen (&bzerr, fp, blockSize100k, workFactor);
   }
   else {
-    bzip2FilePointer = BZ2_bzReadOpen (&bzerr, fp, isSmallMode, unused, 0);
+    bzip2FilePointer = BZ2_bzReadOpenBuffered (&bzerr, fp, isSmallMode, unused, 0, 0);
   }
   if (bzip2FilePointer == NULL) {
     if (fp != stdin && fp != stdout) {
@@ -30,6 +30,18 @@ extern "C" {
   static const int BZ_FLUSH = 1;
   static const int BZ_FINISH = 2;
 
+  static const int BZ_OPT_SORT_ALGORITHM = 0;
+  static const int BZ_OPT_TABLE_TOLERANCE = 1;
+  static const int BZ_OPT_SORT_THREADS = 2;
+  static const int BZ_OPT_SORT_LAYOUT = 3;
+
+  static const int BZ_SORT_AUTO = 0;
+  static const int BZ_SORT_MAIN = 1;
+  static const int BZ_SORT_SAIS = 2;
+
+  static const int BZ_LAYOUT_SPLIT = 0;
+  static const int BZ_LAYOUT_PACKED = 1;
+
 #define BZ_OK                0
 #define BZ_RUN_OK            1
 #define BZ_FLUSH_OK          2
@@ -45,6 +57,8 @@ extern "C" {
 #define BZ_OUTBUFF_FULL      (-8)
 #define BZ_CONFIG_ERROR      (-9)
 
+#define BZ_MAX_THREADS       256
+
   typedef struct {
     char *next_in;
     unsigned int avail_in;
@@ -74,6 +88,42 @@ extern "C" {
       int        workFactor
    );
 
+  /*-- sizes the block buffers for at most sizeHint bytes of input --*/
+  extern int BZ2_bzCompressInitSized (
+      bz_stream*   strm,
+      int          blockSize100k,
+      int          workFactor,
+      unsigned int sizeHint
+   );
+
+  extern int BZ2_bzCompressInitMT (
+      bz_stream* strm,
+      int        blockSize100k,
+      int        workFactor,
+      int        nThreads
+   );
+
+  /*-- BZ_OPT_SORT_THREADS > 1 is rejected on BZ2_bzCompressInitMT streams --*/
+  extern int BZ2_bzCompressSetOption (
+      bz_stream* strm,
+      int        option,
+      int        value
+   );
+
+  /*-- how the blocks of a stream were sorted --*/
+  typedef struct {
+    unsigned int mainSort;   /* blocks sorted by the main sort */
+    unsigned int sais;       /* blocks sorted by SA-IS */
+    unsigned int fallback;   /* blocks sorted by the fallback sort */
+    unsigned int probed;     /* blocks the probe sent past the main sort */
+    unsigned int abandoned;  /* blocks on which the main sort gave up */
+  } bz_sort_stats;
+
+  extern int BZ2_bzCompressGetSortStats (
+      bz_stream*     strm,
+      bz_sort_stats* stats
+   );
+
   extern int BZ2_bzCompress (
       bz_stream* strm,
       int action
@@ -83,6 +133,38 @@ extern "C" {
       bz_stream* strm
    );
 
+  /*-- starts a new stream, keeping the buffers of strm --*/
+  extern int BZ2_bzCompressReset (
+      bz_stream* strm
+   );
+
+  extern unsigned int BZ2_bzCombineCRC (
+      unsigned int crc1,
+      unsigned int crc2,
+      int          nBlocks2
+   );
+
+  extern int BZ2_bzCompressBlock (
+      char*         dest,
+      unsigned int* destLen,
+      unsigned int* nBits,
+      char*         source,
+      unsigned int* sourceLen,
+      int           blockSize100k,
+      int           workFactor,
+      unsigned int* blockCRC
+   );
+
+  extern int BZ2_bzStitchBlocks (
+      char*         dest,
+      unsigned int* destLen,
+      int           blockSize100k,
+      int           nBlocks,
+      char**        blocks,
+      unsigned int* blockBits,
+      unsigned int* blockCRCs
+   );
+
   extern int BZ2_bzDecompressInit (
       bz_stream *strm,
       int       small
@@ -96,6 +178,11 @@ extern "C" {
       bz_stream *strm
    );
 
+  /*-- starts a new stream, keeping the buffers of strm --*/
+  extern int BZ2_bzDecompressReset (
+      bz_stream *strm
+   );
+
 
 
 /*-- High(er) level library functions --*/
@@ -110,6 +197,16 @@ typedef void BZFILE;
       int   nUnused
    );
 
+  /*-- bufferSize == 0 selects the default of 1 MiB --*/
+  extern BZFILE* BZ2_bzReadOpenBuffered (
+      int*  bzerror,
+      FILE* f,
+      int   small,
+      void* unused,
+      int   nUnused,
+      int   bufferSize
+   );
+
   extern void BZ2_bzReadClose (
       int*    bzerror,
       BZFILE* b
@@ -136,6 +233,15 @@ typedef void BZFILE;
       int   workFactor
    );
 
+  /*-- bufferSize == 0 selects the default of 1 MiB --*/
+  extern BZFILE* BZ2_bzWriteOpenBuffered (
+      int*  bzerror,
+      FILE* f,
+      int   blockSize100k,
+      int   workFactor,
+      int   bufferSize
+   );
+
   extern void BZ2_bzWrite (
       int*    bzerror,
       BZFILE* b,
@@ -162,6 +268,73 @@ typedef void BZFILE;
    );
 
 
+/*-- Random access through a block index --*/
+
+typedef void BZINDEX;
+typedef void BZSEEKFILE;
+
+  extern BZINDEX* BZ2_bzIndexBuild (
+      int*  bzerror,
+      FILE* f,
+      int   small
+   );
+
+  extern BZINDEX* BZ2_bzIndexLoad (
+      int*  bzerror,
+      FILE* f
+   );
+
+  extern void BZ2_bzIndexSave (
+      int*     bzerror,
+      BZINDEX* index,
+      FILE*    f
+   );
+
+  /*-- loads path.idx, or builds the index and writes path.idx --*/
+  extern BZINDEX* BZ2_bzIndexOpen (
+      int*        bzerror,
+      const char* path,
+      int         small
+   );
+
+  extern unsigned long long BZ2_bzIndexSize (
+      BZINDEX* index
+   );
+
+  extern void BZ2_bzIndexFree (
+      BZINDEX* index
+   );
+
+  extern BZSEEKFILE* BZ2_bzSeekOpen (
+      int*     bzerror,
+      FILE*    f,
+      int      small,
+      BZINDEX* index
+   );
+
+  extern void BZ2_bzSeek (
+      int*               bzerror,
+      BZSEEKFILE*        b,
+      unsigned long long offset
+   );
+
+  extern unsigned long long BZ2_bzSeekTell (
+      BZSEEKFILE* b
+   );
+
+  extern int BZ2_bzSeekRead (
+      int*        bzerror,
+      BZSEEKFILE* b,
+      void*       buf,
+      int         len
+   );
+
+  extern void BZ2_bzSeekClose (
+      int*        bzerror,
+      BZSEEKFILE* b
+   );
+
+
 /*-- Utility functions --*/
 
   extern int BZ2_bzBuffToBuffCompress (
@@ -181,6 +354,32 @@ typedef void BZFILE;
       int           small
    );
 
+  typedef struct {
+    char*        source;
+    unsigned int sourceLen;
+    char*        dest;
+    unsigned int destLen;   /* in: size of dest; out: bytes written */
+    int          status;    /* out: as BZ2_bzBuffToBuffCompress */
+  } bz_batch_item;
+
+  extern int BZ2_bzBuffToBuffCompressBatch (
+      bz_batch_item* items,
+      int            nItems,
+      int            blockSize100k,
+      int            workFactor,
+      int            nThreads
+   );
+
+  /*-- same results as BZ2_bzBuffToBuffDecompress, errors included --*/
+  extern int BZ2_bzBuffToBuffDecompressMT (
+      char*         dest,
+      unsigned int* destLen,
+      char*         source,
+      unsigned int  sourceLen,
+      int           small,
+      int           nThreads
+   );
+
 
 /*--
    Code contributed by Yoshioka Tsuneo (tsuneo@rr.iij4u.or.jp)
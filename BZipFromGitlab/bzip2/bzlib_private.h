@@ -39,15 +39,39 @@ typedef int             Int32;
 typedef unsigned int    UInt32;
 typedef short           Int16;
 typedef unsigned short  UInt16;
+typedef unsigned long long UInt64;
 
 static const unsigned char True =  ((Bool)1);
 static const unsigned char False = ((Bool)0);
 
 static const int BUFFER_SIZE = 5000;
 
+/*-- Default I/O buffer of a BZFILE handle (1 MiB). --*/
+static const int BZ_IO_BUFFER_SIZE = 1048576;
+
 #define BZALLOC(nnn) (strm->bzalloc)(strm->opaque,(nnn),1)
 #define BZFREE(ppp)  (strm->bzfree)(strm->opaque,(ppp))
 
+/*-- Unaligned big-endian loads: the first byte ends up
+     most significant, so word order is byte order. --*/
+static inline UInt64 loadBE64 ( const UChar* p ) {
+  UInt64 w;
+  memcpy ( &w, p, 8 );
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ != __ORDER_BIG_ENDIAN__
+  w = __builtin_bswap64 ( w );
+#endif
+  return w;
+}
+
+static inline UInt32 loadBE32 ( const UChar* p ) {
+  UInt32 w;
+  memcpy ( &w, p, 4 );
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ != __ORDER_BIG_ENDIAN__
+  w = __builtin_bswap32 ( w );
+#endif
+  return w;
+}
+
 
 /*-- Header bytes. --*/
 
@@ -56,6 +80,11 @@ static int const BZ_HDR_Z = 0x5a;  /* 'Z' */
 static int const BZ_HDR_h = 0x68;  /* 'h' */
 static int const BZ_HDR_0 = 0x30;  /* '0' */
 
+/*-- Block and end-of-stream magics (48 bits). --*/
+
+static const UInt64 BZ_BLOCK_MAGIC = 0x314159265359ULL;
+static const UInt64 BZ_EOS_MAGIC   = 0x177245385090ULL;
+
 /*-- Constants for the back end. --*/
 
 static const int BZ_MAX_ALPHA_SIZE = 258;
@@ -68,6 +97,16 @@ static const int BZ_N_GROUPS  = 6;
 static const int BZ_G_SIZE    = 50;
 static const int BZ_N_ITERS   = 4;
 
+/*-- Codes up to this length are decoded with one table lookup. --*/
+static const int BZ_HUFF_LOOKUP_BITS = 10;
+#define BZ_HUFF_LOOKUP_SIZE (1 << BZ_HUFF_LOOKUP_BITS)
+
+/*-- Input from which on the non-suspending MTF decoder is tried. --*/
+static const int BZ_FAST_MIN_INPUT = 64;
+
+/*-- Blocks from which on the inverse BWT walks two chains. --*/
+static const int BZ_IBWT_MIN_BLOCK = 65536;
+
 #define BZ_MAX_SELECTORS (2 + (900000 / BZ_G_SIZE))
 
 
@@ -108,6 +147,20 @@ extern void BZ_FINALISE_CRC (unsigned int *crcVar);
 // nach bzlib verschoben
 extern void BZ_UPDATE_CRC(uint32_t *crcVar, uint8_t cha); // Nur Deklaration!
 
+extern UInt32 BZ2_crcUpdate ( UInt32, const UChar*, UInt32 );
+
+extern UInt32 BZ2_crcUpdateRun ( UInt32, UChar, UInt32 );
+
+
+/*-- CPU features for the SIMD kernels, see cpu.c --*/
+
+/* SSE2 on x86-64, NEON on ARM */
+static const int BZ_CPU_SIMD  = 0x01;
+/* PCLMULQDQ and SSSE3 */
+static const int BZ_CPU_CLMUL = 0x02;
+
+extern UInt32 BZ2_cpuFeatures ( void );
+
 /*-- States and modes for compression. --*/
 
 typedef enum {
@@ -125,6 +178,30 @@ static const int BZ_N_QSORT = 12;
 static const int BZ_N_SHELL = 18;
 #define BZ_N_OVERSHOOT (BZ_N_RADIX + BZ_N_QSORT + BZ_N_SHELL + 2)
 
+/* at most this many threads share the initial radix sort */
+static const int BZ_SORT_HIST_MAX = 16;
+
+
+
+
+/*-- Thread pool (threadpool.c). --*/
+
+typedef struct bzPoolTask {
+  void  (*run)( void* );
+  void*  arg;
+  Bool   done;
+  struct bzPoolTask* next;
+}
+bzPoolTask;
+
+typedef struct bzPool bzPool;
+
+extern bzPool* BZ2_poolCreate  ( Int32 );
+extern void    BZ2_poolDestroy ( bzPool* );
+extern Int32   BZ2_poolSize    ( bzPool* );
+extern void    BZ2_poolSubmit  ( bzPool*, bzPoolTask* );
+extern Bool    BZ2_poolIsDone  ( bzPool*, bzPoolTask* );
+extern void    BZ2_poolWait    ( bzPool*, bzPoolTask* );
 
 
 
@@ -156,6 +233,23 @@ typedef struct {
   /* for deciding when to use the fallback sorting algorithm */
   Int32    workFactor;
   
+  /* BZ_SORT_*, chosen with BZ2_bzCompressSetOption */
+  Int32    sortAlgorithm;
+  
+  /* BZ_LAYOUT_*, how mainSort lays out block and quadrant */
+  Int32    sortLayout;
+  
+  /* per mille of coding cost below which table refinement stops */
+  Int32    tableTolerance;
+  
+  /* helpers for sorting a single block, NULL for none */
+  bzPool*  sortPool;
+  /* per-helper 2-byte histograms, 65536 counters each */
+  UInt32*  sortHist;
+  
+  /* which sort each block got, see BZ2_bzCompressGetSortStats */
+  bz_sort_stats sortStats;
+  
   /* run-length-encoding of the input */
   UInt32   state_in_ch;
   Int32    state_in_len;
@@ -172,8 +266,8 @@ typedef struct {
   Bool     inUse[256];
   UChar    unseqToSeq[256];
   
-  /* the buffer for bit stream creation */
-  UInt32   bsBuff;
+  /* the buffer for bit stream creation, filled from the top bit */
+  UInt64   bsBuff;
   Int32    bsLive;
   
   /* block and combined CRCs */
@@ -193,13 +287,43 @@ typedef struct {
   UChar    len     [BZ_N_GROUPS][BZ_MAX_ALPHA_SIZE];
   Int32    code    [BZ_N_GROUPS][BZ_MAX_ALPHA_SIZE];
   Int32    rfreq   [BZ_N_GROUPS][BZ_MAX_ALPHA_SIZE];
-  /* second dimension: only 3 needed; 4 makes index calculations faster */
-  UInt32   len_pack[BZ_MAX_ALPHA_SIZE][4];
+  /* lane t holds len[t][v]; 8 lanes fill one 128-bit vector */
+  UInt16   len_pack[BZ_MAX_ALPHA_SIZE][8];
+  
+  /* block-parallel compression, NULL if single-threaded */
+  struct MTState* mt;
   
 }
 EState;
 
 
+/*-- Block-parallel compression. --*/
+
+typedef struct {
+  bzPoolTask task;
+  /* owns arr1/arr2/ftab of the block while it is compressed */
+  EState*    es;
+  /* length of the compressed block in bits */
+  Int32      nBits;
+}
+MTJob;
+
+typedef struct MTState {
+  bzPool*  pool;
+  Int32    nJobs;
+  MTJob*   jobs;
+  /* oldest block not yet written out, and number of blocks in flight */
+  Int32    head;
+  Int32    count;
+  /* zbits currently points into jobs[head] */
+  Bool     emitting;
+  Bool     trailerDone;
+  /* stream header and trailer */
+  UChar    edge[16];
+}
+MTState;
+
+
 
 /*-- externs for compression. --*/
 
@@ -207,6 +331,14 @@ extern void BZ2_blockSort ( EState* );
 
 extern void BZ2_compressBlock ( EState*, Bool );
 
+extern Int32 BZ2_compressBlockBits ( EState* );
+
+extern void BZ2_compressStreamHeader ( EState* );
+
+extern void BZ2_compressStreamTrailer ( EState* );
+
+extern void BZ2_bsSpliceBlock ( EState*, UChar*, Int32 );
+
 extern void BZ2_bsInitWrite ( EState* );
 
 extern void BZ2_hbAssignCodes ( Int32*, UChar*, Int32, Int32, Int32 );
@@ -285,13 +417,15 @@ typedef struct {
   BZ_RAND_DECLS;
   
   /* the buffer for bit stream reading */
-  UInt32   bsBuff;
+  UInt64   bsBuff;
   Int32    bsLive;
   
   /* misc administratium */
   Int32    blockSize100k;
   Bool     smallDecompress;
   Int32    currBlockNo;
+  /* stop with BZ_STREAM_END after the current block */
+  Bool     singleBlock;
   
   /* for undoing the Burrows-Wheeler transform */
   Int32    origPtr;
@@ -302,8 +436,16 @@ typedef struct {
   Int32    cftab[257];
   Int32    cftabCopy[257];
   
+  /* block size tt or ll16/ll4 are allocated for, 0 if none */
+  Int32    ttBlockSize100k;
+  
   /* for undoing the Burrows-Wheeler transform (FAST) */
   UInt32   *tt;
+  /* predecessor chain and the block decoded by two walkers */
+  UInt32   *lf;
+  UChar    *bwtBlock;
+  Int32    bwtBlockSize100k;
+  Bool     bwtDecoded;
   
   /* for undoing the Burrows-Wheeler transform (SMALL) */
   UInt16   *ll16;
@@ -332,6 +474,8 @@ typedef struct {
   Int32    base   [BZ_N_GROUPS][BZ_MAX_ALPHA_SIZE];
   Int32    perm   [BZ_N_GROUPS][BZ_MAX_ALPHA_SIZE];
   Int32    minLens[BZ_N_GROUPS];
+  /* (length << 9) | symbol for codes of at most BZ_HUFF_LOOKUP_BITS, else 0 */
+  UInt16   lookup [BZ_N_GROUPS][BZ_HUFF_LOOKUP_SIZE];
   
   /* save area for scalars in the main decompress code */
   Int32    save_i;
@@ -358,6 +502,7 @@ typedef struct {
   Int32*   save_gLimit;
   Int32*   save_gBase;
   Int32*   save_gPerm;
+  UInt16*  save_gLookup;
   
 }
 DState;
@@ -380,6 +525,14 @@ DState;
     cccc = (UChar)(c_tPos & 0xff);            \
     c_tPos >>= 8;
 
+#define BZ_GET_NEXT_C(cccc)                   \
+    if (c_block != NULL) {                    \
+      cccc = c_block[c_nblock_used];          \
+    }                                         \
+    else {                                    \
+      BZ_GET_FAST_C(cccc);                    \
+    }
+
 #define SET_LL4(i,n)                                          \
    { if (((i) & 0x1) == 0)                                    \
         s->ll4[(i) >> 1] = (s->ll4[(i) >> 1] & 0xf0) | (n); else    \
@@ -410,8 +563,66 @@ extern Int32 BZ2_indexIntoF ( Int32, Int32* );
 
 extern Int32 BZ2_decompress ( DState* );
 
+extern Int32 BZ2_decompressEnterBlock ( bz_stream*, Int32, Int32 );
+
+
+/*-- Block-parallel decompression (mtdecompress.c). --*/
+
+typedef Int32 (*BZ2_mtSink) ( void*, const UChar*, UInt32 );
+
+typedef struct {
+  bzPoolTask   task;
+  bz_stream    strm;
+  const UChar* src;
+  UInt64       srcLen;
+  /* where to start and with which block size limit */
+  UInt64       startBit;
+  Int32        blockSize100k;
+  /* result: BZ_OK or an error code, bit after the block */
+  Int32        ret;
+  UInt64       endBit;
+  UInt32       blockCRC;
+  Int32        nblock;
+  UChar*       out;
+  UInt32       outLen;
+  UInt32       outCap;
+}
+MTDecodeJob;
+
+typedef struct {
+  const UChar* src;
+  UInt64       srcLen;
+  Int32        small;
+  BZ2_mtSink   sink;
+  void*        opaque;
+  /* current position in the real chain of blocks */
+  UInt64       pos;
+  Int32        blockSize100k;
+  /* block magics found so far */
+  UInt64*      cand;
+  Int32        nCand;
+  Int32        capCand;
+  Int32        nextCand;
+  UInt64       scanByte;
+  UInt64       scanWindow;
+  /* speculative jobs, ordered by startBit */
+  bzPool*      pool;
+  MTDecodeJob* jobs;
+  Int32        nJobs;
+  Int32        head;
+  Int32        count;
+  /* used when no speculative result is available */
+  MTDecodeJob  self;
+}
+MTDecoder;
+
+extern Int32 BZ2_decompressMT ( const UChar*, UInt64, Int32, Int32, Bool,
+                                BZ2_mtSink, void*, Int32* );
+
 extern void BZ2_hbCreateDecodeTables ( Int32*, Int32*, Int32*, UChar*, Int32,  Int32, Int32 );
 
+extern void BZ2_hbCreateLookupTable ( UInt16*, Int32*, Int32*, Int32*, Int32 );
+
 
 #endif
 
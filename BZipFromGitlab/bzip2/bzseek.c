@@ -0,0 +1,746 @@
+
+/*-------------------------------------------------------------*/
+/*--- Random access through a block index                   ---*/
+/*---                                              bzseek.c ---*/
+/*-------------------------------------------------------------*/
+
+/* ------------------------------------------------------------------
+   This file is part of bzip2/libbzip2, a program and library for
+   lossless, block-sorting data compression.
+
+   bzip2/libbzip2 version 1.1.0 of 6 September 2010
+   Copyright (C) 1996-2010 Julian Seward <jseward@acm.org>
+
+   Please read the WARNING, DISCLAIMER and PATENTS sections in the
+   README file.
+
+   This program is released under the terms of the license contained
+   in the file COPYING.
+   ------------------------------------------------------------------ */
+
+/*--
+   Jeder Block einer .bz2-Datei ist ab seiner Magic unabhängig
+   dekodierbar. Der Index hält für jeden Block die Bitposition der
+   Magic, den Offset seines ersten Bytes in der unkomprimierten
+   Ausgabe und die Blockgröße des Streams, zu dem er gehört.
+
+   Ein Lesezugriff an einem beliebigen Offset sucht den Block per
+   Binärsuche, steigt mit BZ2_decompressEnterBlock direkt an dessen
+   Bitposition ein und verwirft nur die Ausgabe dieses einen Blocks
+   bis zum gewünschten Offset.
+
+   Der Index wird einmal durch vollständiges Dekodieren aufgebaut
+   und kann als Begleitdatei gespeichert werden.
+--*/
+
+#include <sys/stat.h>
+
+#include "bzlib_private.h"
+
+
+static const int BZ_SEEK_IN_SIZE   = 65536;
+static const int BZ_SEEK_SKIP_SIZE = 65536;
+
+/*-- Kopf der Begleitdatei: "BZIX" und Formatversion --*/
+static const UChar  BZ_INDEX_MAGIC[4] = { 'B', 'Z', 'I', 'X' };
+static const UChar  BZ_INDEX_VERSION  = 2;
+
+
+typedef struct {
+  UInt64 startBit;
+  UInt64 outOffset;
+  Int32  blockSize100k;
+}
+bzIndexEntry;
+
+typedef struct {
+  bzIndexEntry* entries;
+  Int32         nEntries;
+  Int32         capEntries;
+  /* Länge der unkomprimierten Daten und der .bz2-Streams */
+  UInt64        totalOut;
+  UInt64        srcLen;
+  /* Größe und Änderungszeit der indizierten Datei */
+  UInt64        fileSize;
+  UInt64        fileMtime;
+}
+bzIndex;
+
+typedef struct {
+  FILE*     handle;
+  bzIndex*  index;
+  bz_stream strm;
+  Bool      initialisedOk;
+  Int32     lastErr;
+  /* Eingabefenster, beginnt am Datei-Offset inPos */
+  UChar     in[BZ_SEEK_IN_SIZE];
+  UInt64    inPos;
+  Int32     inN;
+  /* aktiver Block und Offset des nächsten dekodierten Bytes */
+  Int32     block;
+  Bool      blockActive;
+  UInt64    outPos;
+  /* Offset, den der nächste Leseaufruf liefert */
+  UInt64    target;
+  UChar     skip[BZ_SEEK_SKIP_SIZE];
+}
+bzSeekFile;
+
+
+#define BZ_SETERR(eee)                    \
+{                                         \
+if (bzerror != NULL) {*bzerror = eee;}   \
+if (bzf != NULL) {bzf->lastErr = eee;}   \
+}
+
+
+/*---------------------------------------------------*/
+/* Liest die Datei ab dem Byte-Offset `byte` in das Eingabefenster. */
+static Int32 read_input ( bzSeekFile* bzf, UInt64 byte ) {
+  size_t n;
+
+  if (fseeko ( bzf->handle, (off_t)byte, SEEK_SET ) != 0) {
+    return BZ_IO_ERROR;
+  }
+  n = fread ( bzf->in, sizeof(UChar), BZ_SEEK_IN_SIZE, bzf->handle );
+  if (ferror(bzf->handle)) {
+    return BZ_IO_ERROR;
+  }
+  bzf->inPos = byte;
+  bzf->inN   = (Int32)n;
+  bzf->strm.next_in  = (char*)bzf->in;
+  bzf->strm.avail_in = (unsigned int)n;
+  return (n == 0) ? BZ_UNEXPECTED_EOF : BZ_OK;
+}
+
+
+/*---------------------------------------------------*/
+/* Liefert `n` <= 57 Bits ab der Bitposition `bitPos`. */
+static Int32 peek_bits ( bzSeekFile* bzf, UInt64 bitPos, Int32 n, UInt64* v ) {
+  UInt64 first = bitPos / 8;
+  UInt64 last  = (bitPos + n - 1) / 8;
+  UInt64 w     = 0;
+  Int32  r;
+
+  if (first < bzf->inPos || last >= bzf->inPos + bzf->inN) {
+    r = read_input ( bzf, first );
+    if (r != BZ_OK) {
+      return r;
+    }
+    if (last >= bzf->inPos + bzf->inN) {
+      return BZ_UNEXPECTED_EOF;
+    }
+  }
+  for (UInt64 i = first; i <= last; i++) {
+    w = (w << 8) | bzf->in[i - bzf->inPos];
+  }
+  w >>= 7 - (bitPos + n - 1) % 8;
+  *v = w & ((1ULL << n) - 1);
+  return BZ_OK;
+}
+
+
+/*---------------------------------------------------*/
+/* Setzt den Dekoder an die Magic des Blocks `b` des Index. */
+static Int32 enter_block ( bzSeekFile* bzf, Int32 b ) {
+  bzIndexEntry* e    = &bzf->index->entries[b];
+  UInt64        byte = e->startBit / 8;
+  Int32         r;
+
+  if (byte < bzf->inPos || byte >= bzf->inPos + bzf->inN) {
+    r = read_input ( bzf, byte );
+    if (r != BZ_OK) {
+      return r;
+    }
+  }
+  bzf->strm.next_in  = (char*)(bzf->in + (byte - bzf->inPos));
+  bzf->strm.avail_in = (unsigned int)(bzf->inPos + bzf->inN - byte);
+  r = BZ2_decompressEnterBlock ( &bzf->strm, e->blockSize100k, (Int32)(e->startBit % 8) );
+  if (r != BZ_OK) {
+    return r;
+  }
+  bzf->block       = b;
+  bzf->blockActive = True;
+  bzf->outPos      = e->outOffset;
+  return BZ_OK;
+}
+
+
+/*---------------------------------------------------*/
+/**
+ * @brief Dekodiert bis zu `cap` Bytes des aktiven Blocks nach `out`.
+ *
+ * @return `BZ_OK`, solange der Block weitergeht, `BZ_STREAM_END` an
+ * seinem Ende, sonst einen Fehlercode wie von `BZ2_bzDecompress`.
+ */
+static Int32 decode_some ( bzSeekFile* bzf, UChar* out, UInt32 cap, UInt32* produced ) {
+  Int32 r;
+
+  bzf->strm.next_out  = (char*)out;
+  bzf->strm.avail_out = cap;
+  while (True) {
+    if (bzf->strm.avail_in == 0) {
+      r = read_input ( bzf, bzf->inPos + bzf->inN );
+      if (r != BZ_OK) {
+        break;
+      }
+    }
+    r = BZ2_bzDecompress ( &bzf->strm );
+    if (r != BZ_OK || bzf->strm.avail_out == 0) {
+      break;
+    }
+  }
+  *produced = cap - bzf->strm.avail_out;
+  bzf->outPos += *produced;
+  if (r == BZ_STREAM_END) {
+    bzf->blockActive = False;
+  }
+  return r;
+}
+
+
+/*---------------------------------------------------*/
+/* Bitposition direkt hinter dem gerade beendeten Block. */
+static UInt64 block_end_bit ( bzSeekFile* bzf ) {
+  DState* s = bzf->strm.state;
+  return 8 * (bzf->inPos + (UInt64)((UChar*)bzf->strm.next_in - bzf->in)) - s->bsLive;
+}
+
+
+/*---------------------------------------------------*/
+/* Ausgabe-Offset, an dem laut Index der aktive Block endet. */
+static UInt64 block_out_end ( bzSeekFile* bzf ) {
+  bzIndex* idx = bzf->index;
+  return (bzf->block + 1 < idx->nEntries) ? idx->entries[bzf->block + 1].outOffset : idx->totalOut;
+}
+
+
+/*---------------------------------------------------*/
+static Int32 index_add ( bzIndex* idx, UInt64 startBit, UInt64 outOffset, Int32 blockSize100k ) {
+  if (idx->nEntries == idx->capEntries) {
+    Int32         cap = (idx->capEntries == 0) ? 256 : 2 * idx->capEntries;
+    bzIndexEntry* e   = realloc ( idx->entries, cap * sizeof(bzIndexEntry) );
+    if (e == NULL) {
+      return BZ_MEM_ERROR;
+    }
+    idx->entries    = e;
+    idx->capEntries = cap;
+  }
+  idx->entries[idx->nEntries].startBit      = startBit;
+  idx->entries[idx->nEntries].outOffset     = outOffset;
+  idx->entries[idx->nEntries].blockSize100k = blockSize100k;
+  idx->nEntries += 1;
+  return BZ_OK;
+}
+
+
+/*---------------------------------------------------*/
+static bzSeekFile* seek_alloc ( FILE* f, int small, bzIndex* idx, Int32* ret ) {
+  bzSeekFile* bzf = malloc ( sizeof(bzSeekFile) );
+
+  if (bzf == NULL) {
+    *ret = BZ_MEM_ERROR;
+    return NULL;
+  }
+  bzf->handle        = f;
+  bzf->index         = idx;
+  bzf->initialisedOk = False;
+  bzf->lastErr       = BZ_OK;
+  bzf->inPos         = 0;
+  bzf->inN           = 0;
+  bzf->block         = -1;
+  bzf->blockActive   = False;
+  bzf->outPos        = 0;
+  bzf->target        = 0;
+  bzf->strm.bzalloc  = NULL;
+  bzf->strm.bzfree   = NULL;
+  bzf->strm.opaque   = NULL;
+  *ret = BZ2_bzDecompressInit ( &bzf->strm, small );
+  if (*ret != BZ_OK) {
+    free ( bzf );
+    return NULL;
+  }
+  bzf->initialisedOk = True;
+  return bzf;
+}
+
+
+/*---------------------------------------------------*/
+static void seek_free ( bzSeekFile* bzf ) {
+  if (bzf->initialisedOk) {
+    (void)BZ2_bzDecompressEnd ( &bzf->strm );
+  }
+  free ( bzf );
+}
+
+
+/*---------------------------------------------------*/
+/**
+ * @brief Dekodiert einen Stream ab `*pos` und trägt seine Blöcke ein.
+ *
+ * Prüft wie `BZ2_bzDecompress` die Block-CRCs und die kombinierte
+ * CRC. `*pos` steht danach auf dem ersten Byte hinter dem Stream.
+ */
+static Int32 index_stream ( bzSeekFile* bzf, UInt64* pos ) {
+  bzIndex* idx = bzf->index;
+  UInt32   combinedCRC = 0;
+  UInt64   v;
+  Int32    blockSize100k;
+  Int32    r;
+
+  r = peek_bits ( bzf, *pos, 32, &v );
+  if (r != BZ_OK) {
+    return r;
+  }
+  if ((v >> 8) != (((UInt64)BZ_HDR_B << 16) | ((UInt64)BZ_HDR_Z << 8) | BZ_HDR_h)
+      || (v & 0xff) < BZ_HDR_0 + 1 || (v & 0xff) > BZ_HDR_0 + 9) {
+    return BZ_DATA_ERROR_MAGIC;
+  }
+  blockSize100k = (Int32)(v & 0xff) - BZ_HDR_0;
+  *pos += 32;
+
+  while (True) {
+    r = peek_bits ( bzf, *pos, 48, &v );
+    if (r != BZ_OK) {
+      return r;
+    }
+    if (v == BZ_EOS_MAGIC) {
+      r = peek_bits ( bzf, *pos + 48, 32, &v );
+      if (r != BZ_OK) {
+        return r;
+      }
+      if ((UInt32)v != combinedCRC) {
+        return BZ_DATA_ERROR;
+      }
+      *pos = ((*pos + 80 + 7) / 8) * 8;
+      return BZ_STREAM_END;
+    }
+    if (v != BZ_BLOCK_MAGIC) {
+      return BZ_DATA_ERROR;
+    }
+
+    r = index_add ( idx, *pos, idx->totalOut, blockSize100k );
+    if (r != BZ_OK) {
+      return r;
+    }
+    r = enter_block ( bzf, idx->nEntries - 1 );
+    while (r == BZ_OK) {
+      UInt32 n;
+      r = decode_some ( bzf, bzf->skip, BZ_SEEK_SKIP_SIZE, &n );
+      idx->totalOut += n;
+    }
+    if (r != BZ_STREAM_END) {
+      return r;
+    }
+    combinedCRC = (combinedCRC << 1) | (combinedCRC >> 31);
+    combinedCRC ^= ((DState*)bzf->strm.state)->storedBlockCRC;
+    *pos = block_end_bit ( bzf );
+  }
+}
+
+
+/*---------------------------------------------------*/
+BZINDEX* BZ2_bzIndexBuild ( int* bzerror, FILE* f, int small ) {
+  bzSeekFile* bzf = NULL;
+  bzIndex*    idx;
+  struct stat st;
+  UInt64      pos = 0;
+  Int32       nStreams = 0;
+  Int32       r;
+
+  BZ_SETERR(BZ_OK);
+  if (f == NULL || (small != 0 && small != 1)) {
+    BZ_SETERR(BZ_PARAM_ERROR);
+    return NULL;
+  }
+  idx = calloc ( 1, sizeof(bzIndex) );
+  if (idx == NULL) {
+    BZ_SETERR(BZ_MEM_ERROR);
+    return NULL;
+  }
+  bzf = seek_alloc ( f, small, idx, &r );
+  if (bzf == NULL) {
+    free ( idx );
+    BZ_SETERR(r);
+    return NULL;
+  }
+
+  /*-- hintereinander gehängte Streams wie bei bzip2 --*/
+  while (True) {
+    UInt64 v;
+    UInt64 start = pos;
+    /* Dateiende oder weniger als ein Kopf an Fremddaten */
+    if (nStreams > 0 && peek_bits ( bzf, pos, 32, &v ) == BZ_UNEXPECTED_EOF) {
+      r = BZ_OK;
+      break;
+    }
+    r = index_stream ( bzf, &pos );
+    if (r == BZ_STREAM_END) {
+      nStreams += 1;
+      continue;
+    }
+    if (nStreams > 0 && r == BZ_DATA_ERROR_MAGIC) {
+      /* Fremddaten hinter dem letzten Stream */
+      pos = start;
+      r = BZ_OK;
+    }
+    break;
+  }
+  idx->srcLen = pos / 8;
+  if (fstat ( fileno ( f ), &st ) == 0) {
+    idx->fileSize  = (UInt64)st.st_size;
+    idx->fileMtime = (UInt64)st.st_mtime;
+  }
+
+  seek_free ( bzf );
+  bzf = NULL;
+  if (r != BZ_OK) {
+    BZ2_bzIndexFree ( idx );
+    BZ_SETERR(r);
+    return NULL;
+  }
+  return idx;
+}
+
+
+/*---------------------------------------------------*/
+void BZ2_bzIndexFree ( BZINDEX* index ) {
+  bzIndex* idx = (bzIndex*)index;
+  if (idx != NULL) {
+    free ( idx->entries );
+    free ( idx );
+  }
+}
+
+
+/*---------------------------------------------------*/
+unsigned long long BZ2_bzIndexSize ( BZINDEX* index ) {
+  return (index == NULL) ? 0 : ((bzIndex*)index)->totalOut;
+}
+
+
+/*---------------------------------------------------*/
+/*-- Begleitdatei: Zahlen als 64 Bit little endian --*/
+
+static void put64 ( UChar* p, UInt64 v ) {
+  for (Int32 i = 0; i < 8; i++) {
+    p[i] = (UChar)(v >> (8 * i));
+  }
+}
+
+static UInt64 get64 ( const UChar* p ) {
+  UInt64 v = 0;
+  for (Int32 i = 7; i >= 0; i--) {
+    v = (v << 8) | p[i];
+  }
+  return v;
+}
+
+
+/*---------------------------------------------------*/
+void BZ2_bzIndexSave ( int* bzerror, BZINDEX* index, FILE* f ) {
+  bzIndex*    idx = (bzIndex*)index;
+  bzSeekFile* bzf = NULL;
+  UChar       hdr[45];
+  UChar       rec[17];
+
+  BZ_SETERR(BZ_OK);
+  if (idx == NULL || f == NULL) {
+    BZ_SETERR(BZ_PARAM_ERROR);
+    return;
+  }
+  memcpy ( hdr, BZ_INDEX_MAGIC, 4 );
+  hdr[4] = BZ_INDEX_VERSION;
+  put64 ( hdr + 5,  (UInt64)idx->nEntries );
+  put64 ( hdr + 13, idx->totalOut );
+  put64 ( hdr + 21, idx->srcLen );
+  put64 ( hdr + 29, idx->fileSize );
+  put64 ( hdr + 37, idx->fileMtime );
+  if (fwrite ( hdr, 1, sizeof(hdr), f ) != sizeof(hdr)) {
+    BZ_SETERR(BZ_IO_ERROR);
+    return;
+  }
+  for (Int32 i = 0; i < idx->nEntries; i++) {
+    put64 ( rec,     idx->entries[i].startBit );
+    put64 ( rec + 8, idx->entries[i].outOffset );
+    rec[16] = (UChar)idx->entries[i].blockSize100k;
+    if (fwrite ( rec, 1, sizeof(rec), f ) != sizeof(rec)) {
+      BZ_SETERR(BZ_IO_ERROR);
+      return;
+    }
+  }
+  if (fflush ( f ) != 0 || ferror(f)) {
+    BZ_SETERR(BZ_IO_ERROR);
+  }
+}
+
+
+/*---------------------------------------------------*/
+BZINDEX* BZ2_bzIndexLoad ( int* bzerror, FILE* f ) {
+  bzSeekFile* bzf = NULL;
+  bzIndex*    idx;
+  UChar       hdr[45];
+  UChar       rec[17];
+  UInt64      n;
+
+  BZ_SETERR(BZ_OK);
+  if (f == NULL) {
+    BZ_SETERR(BZ_PARAM_ERROR);
+    return NULL;
+  }
+  if (fread ( hdr, 1, sizeof(hdr), f ) != sizeof(hdr)) {
+    BZ_SETERR(ferror(f) ? BZ_IO_ERROR : BZ_UNEXPECTED_EOF);
+    return NULL;
+  }
+  n = get64 ( hdr + 5 );
+  if (memcmp ( hdr, BZ_INDEX_MAGIC, 4 ) != 0 || hdr[4] != BZ_INDEX_VERSION || n > 0x7fffffffULL) {
+    BZ_SETERR(BZ_DATA_ERROR_MAGIC);
+    return NULL;
+  }
+  idx = calloc ( 1, sizeof(bzIndex) );
+  if (idx == NULL) {
+    BZ_SETERR(BZ_MEM_ERROR);
+    return NULL;
+  }
+  idx->totalOut  = get64 ( hdr + 13 );
+  idx->srcLen    = get64 ( hdr + 21 );
+  idx->fileSize  = get64 ( hdr + 29 );
+  idx->fileMtime = get64 ( hdr + 37 );
+  /* ohne Blöcke keine Ausgabe und umgekehrt */
+  if ((n == 0) != (idx->totalOut == 0)) {
+    BZ2_bzIndexFree ( idx );
+    BZ_SETERR(BZ_DATA_ERROR);
+    return NULL;
+  }
+  for (UInt64 i = 0; i < n; i++) {
+    Int32 r;
+    if (fread ( rec, 1, sizeof(rec), f ) != sizeof(rec)) {
+      BZ2_bzIndexFree ( idx );
+      BZ_SETERR(ferror(f) ? BZ_IO_ERROR : BZ_UNEXPECTED_EOF);
+      return NULL;
+    }
+    /* Einträge müssen aufsteigend und plausibel sein; der erste
+       Block liegt hinter dem Stream-Kopf und beginnt die Ausgabe */
+    if (rec[16] < 1 || rec[16] > 9
+        || (i == 0 && (get64 ( rec ) < 32 || get64 ( rec + 8 ) != 0))
+        || (i > 0 && (get64 ( rec ) <= idx->entries[i - 1].startBit
+                      || get64 ( rec + 8 ) <= idx->entries[i - 1].outOffset))
+        || get64 ( rec ) / 8 >= idx->srcLen
+        || get64 ( rec + 8 ) >= idx->totalOut) {
+      BZ2_bzIndexFree ( idx );
+      BZ_SETERR(BZ_DATA_ERROR);
+      return NULL;
+    }
+    r = index_add ( idx, get64 ( rec ), get64 ( rec + 8 ), rec[16] );
+    if (r != BZ_OK) {
+      BZ2_bzIndexFree ( idx );
+      BZ_SETERR(r);
+      return NULL;
+    }
+  }
+  return idx;
+}
+
+
+/*---------------------------------------------------*/
+/**
+ * @brief Lädt den Index zu `path` aus der Begleitdatei `path.idx`
+ * oder baut ihn auf und legt die Begleitdatei an.
+ *
+ * Die Begleitdatei hält Größe und Änderungszeit der .bz2-Datei fest.
+ * Weicht eines davon ab, gilt sie als veraltet und wird neu
+ * geschrieben. Scheitert nur das Schreiben
+ * der Begleitdatei, wird der Index trotzdem geliefert.
+ */
+BZINDEX* BZ2_bzIndexOpen ( int* bzerror, const char* path, int small ) {
+  bzSeekFile* bzf = NULL;
+  bzIndex*    idx = NULL;
+  FILE*       f;
+  FILE*       side;
+  char*       sidePath;
+  Int32       err;
+  struct stat st;
+
+  BZ_SETERR(BZ_OK);
+  if (path == NULL) {
+    BZ_SETERR(BZ_PARAM_ERROR);
+    return NULL;
+  }
+  f = fopen ( path, "rb" );
+  if (f == NULL) {
+    BZ_SETERR(BZ_IO_ERROR);
+    return NULL;
+  }
+  if (fstat ( fileno ( f ), &st ) != 0) {
+    fclose ( f );
+    BZ_SETERR(BZ_IO_ERROR);
+    return NULL;
+  }
+  sidePath = malloc ( strlen ( path ) + 5 );
+  if (sidePath == NULL) {
+    fclose ( f );
+    BZ_SETERR(BZ_MEM_ERROR);
+    return NULL;
+  }
+  strcpy ( sidePath, path );
+  strcat ( sidePath, ".idx" );
+
+  side = fopen ( sidePath, "rb" );
+  if (side != NULL) {
+    idx = BZ2_bzIndexLoad ( &err, side );
+    fclose ( side );
+    /* veraltet, wenn die .bz2-Datei seither ersetzt wurde */
+    if (idx != NULL && (idx->fileSize != (UInt64)st.st_size
+                        || idx->fileMtime != (UInt64)st.st_mtime
+                        || idx->srcLen > idx->fileSize)) {
+      BZ2_bzIndexFree ( idx );
+      idx = NULL;
+    }
+  }
+  if (idx == NULL) {
+    idx = BZ2_bzIndexBuild ( &err, f, small );
+    if (idx == NULL) {
+      free ( sidePath );
+      fclose ( f );
+      BZ_SETERR(err);
+      return NULL;
+    }
+    side = fopen ( sidePath, "wb" );
+    if (side != NULL) {
+      BZ2_bzIndexSave ( &err, idx, side );
+      fclose ( side );
+      if (err != BZ_OK) {
+        remove ( sidePath );
+      }
+    }
+  }
+  free ( sidePath );
+  fclose ( f );
+  return idx;
+}
+
+
+/*---------------------------------------------------*/
+BZSEEKFILE* BZ2_bzSeekOpen ( int* bzerror, FILE* f, int small, BZINDEX* index ) {
+  bzSeekFile* bzf = NULL;
+  Int32       r;
+
+  BZ_SETERR(BZ_OK);
+  if (f == NULL || index == NULL || (small != 0 && small != 1)) {
+    BZ_SETERR(BZ_PARAM_ERROR);
+    return NULL;
+  }
+  if (ferror(f)) {
+    BZ_SETERR(BZ_IO_ERROR);
+    return NULL;
+  }
+  bzf = seek_alloc ( f, small, (bzIndex*)index, &r );
+  if (bzf == NULL) {
+    BZ_SETERR(r);
+    return NULL;
+  }
+  return bzf;
+}
+
+
+/*---------------------------------------------------*/
+void BZ2_bzSeek ( int* bzerror, BZSEEKFILE* b, unsigned long long offset ) {
+  bzSeekFile* bzf = (bzSeekFile*)b;
+
+  BZ_SETERR(BZ_OK);
+  if (bzf == NULL || offset > bzf->index->totalOut) {
+    BZ_SETERR(BZ_PARAM_ERROR);
+    return;
+  }
+  bzf->target = offset;
+}
+
+
+/*---------------------------------------------------*/
+unsigned long long BZ2_bzSeekTell ( BZSEEKFILE* b ) {
+  return (b == NULL) ? 0 : ((bzSeekFile*)b)->target;
+}
+
+
+/*---------------------------------------------------*/
+int BZ2_bzSeekRead ( int* bzerror, BZSEEKFILE* b, void* buf, int len ) {
+  bzSeekFile* bzf = (bzSeekFile*)b;
+  bzIndex*    idx;
+  Int32       done = 0;
+  Int32       r;
+
+  BZ_SETERR(BZ_OK);
+  if (bzf == NULL || buf == NULL || len < 0) {
+    BZ_SETERR(BZ_PARAM_ERROR);
+    return 0;
+  }
+  idx = bzf->index;
+
+  while (done < len && bzf->target < idx->totalOut) {
+    UInt32 n;
+
+    /*-- liegt der Offset nicht im aktiven Block, neu einsteigen --*/
+    if (!bzf->blockActive || bzf->target < bzf->outPos
+        || (bzf->block + 1 < idx->nEntries && bzf->target >= idx->entries[bzf->block + 1].outOffset)) {
+      Int32 lo = 0;
+      Int32 hi = idx->nEntries - 1;
+      while (lo < hi) {
+        Int32 mid = (lo + hi + 1) / 2;
+        if (idx->entries[mid].outOffset <= bzf->target) {
+          lo = mid;
+        }
+        else {
+          hi = mid - 1;
+        }
+      }
+      r = enter_block ( bzf, lo );
+      if (r != BZ_OK) {
+        BZ_SETERR(r);
+        return 0;
+      }
+    }
+
+    if (bzf->outPos < bzf->target) {
+      UInt64 gap = bzf->target - bzf->outPos;
+      r = decode_some ( bzf, bzf->skip, gap < (UInt64)BZ_SEEK_SKIP_SIZE ? (UInt32)gap : BZ_SEEK_SKIP_SIZE, &n );
+    }
+    else {
+      r = decode_some ( bzf, (UChar*)buf + done, (UInt32)(len - done), &n );
+      done        += n;
+      bzf->target += n;
+    }
+    if (r != BZ_OK && r != BZ_STREAM_END) {
+      bzf->blockActive = False;
+      BZ_SETERR(r);
+      return 0;
+    }
+    /*-- ein Block muss genau am Offset des nächsten enden --*/
+    if (bzf->outPos > block_out_end ( bzf )
+        || (r == BZ_STREAM_END && bzf->outPos != block_out_end ( bzf ))) {
+      bzf->blockActive = False;
+      BZ_SETERR(BZ_DATA_ERROR);
+      return 0;
+    }
+  }
+
+  if (bzf->target == idx->totalOut) {
+    BZ_SETERR(BZ_STREAM_END);
+  }
+  return done;
+}
+
+
+/*---------------------------------------------------*/
+void BZ2_bzSeekClose ( int* bzerror, BZSEEKFILE* b ) {
+  bzSeekFile* bzf = (bzSeekFile*)b;
+
+  BZ_SETERR(BZ_OK);
+  if (bzf != NULL) {
+    seek_free ( bzf );
+  }
+}
+
+
+/*-------------------------------------------------------------*/
+/*--- end                                          bzseek.c ---*/
+/*-------------------------------------------------------------*/
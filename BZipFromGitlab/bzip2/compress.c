@@ -28,6 +28,16 @@
 
 #include "bzlib_private.h"
 
+/*-- The vector kernels are compiled in where the target has
+     them and chosen at run time through BZ2_cpuFeatures. --*/
+#if defined(__SSE2__)
+#define BZ_SIMD_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#define BZ_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
 
 /*---------------------------------------------------*/
 /*--- Bit stream I/O                              ---*/
@@ -40,10 +50,31 @@ void BZ2_bsInitWrite ( EState* s ) {
 }
 
 
+/*---------------------------------------------------*/
+/*--
+   bsBuff holds up to 64 pending bits, most significant
+   first.  Whole bytes leave it big-endian through one
+   unaligned store rather than a byte at a time.
+--*/
+static inline void bsStore32 ( UChar* p, UInt32 v ) {
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ != __ORDER_BIG_ENDIAN__
+  v = __builtin_bswap32 ( v );
+#endif
+  memcpy ( p, &v, 4 );
+}
+
+static inline void bsStore64 ( UChar* p, UInt64 v ) {
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ != __ORDER_BIG_ENDIAN__
+  v = __builtin_bswap64 ( v );
+#endif
+  memcpy ( p, &v, 8 );
+}
+
+
 /*---------------------------------------------------*/
 static void bsFinishWrite ( EState* s ) {
   while (s->bsLive > 0) {
-    s->zbits[s->numZ] = (UChar)(s->bsBuff >> 24);
+    s->zbits[s->numZ] = (UChar)(s->bsBuff >> 56);
     s->numZ += 1;
     s->bsBuff <<= 8;
     s->bsLive -= 8;
@@ -52,19 +83,75 @@ static void bsFinishWrite ( EState* s ) {
 
 
 /*---------------------------------------------------*/
+/*--
+   n <= 32.  At most 31 bits are pending after the flush,
+   so the new ones always fit.
+--*/
 static inline void bsW ( EState* s, Int32 n, UInt32 v ) {
-  while (s->bsLive >= 8) {
-    s->zbits[s->numZ]
-    = (UChar)(s->bsBuff >> 24);
-    s->numZ += 1;
-    s->bsBuff <<= 8;
-    s->bsLive -= 8;
+  if (s->bsLive >= 32) {
+    bsStore32 ( &s->zbits[s->numZ], (UInt32)(s->bsBuff >> 32) );
+    s->numZ += 4;
+    s->bsBuff <<= 32;
+    s->bsLive -= 32;
   }
-  s->bsBuff |= (v << (32 - s->bsLive - n));
+  s->bsBuff |= ((UInt64)v << (64 - s->bsLive - n));
   s->bsLive += n;
 }
 
 
+/*---------------------------------------------------*/
+/*--
+   Emits the codes for one selector group, keeping the
+   writer state in registers.  Code lengths are at most
+   17, so after flushing all whole bytes (leaving < 8
+   bits) three codes fit the buffer.  The 8-byte store
+   may write up to 7 bytes beyond numZ; zbits lies in
+   arr2, which has ample room behind the output.
+--*/
+static inline void bsWGroup ( EState* s,
+                              const UChar* len,
+                              const Int32* code,
+                              const UInt16* mtfv,
+                              Int32 n ) {
+  UInt64 buff = s->bsBuff;
+  Int32  live = s->bsLive;
+  UChar* z    = &s->zbits[s->numZ];
+  Int32  i    = 0;
+  
+#define BZ_PUT_CODE(v)                                      \
+  {                                                         \
+    UInt16 sym = (v);                                       \
+    buff |= (UInt64)code[sym] << (64 - live - len[sym]);    \
+    live += len[sym];                                       \
+  }
+#define BZ_FLUSH_BYTES                                      \
+  {                                                         \
+    bsStore64 ( z, buff );                                  \
+    z    += live >> 3;                                      \
+    buff <<= live & ~7;                                     \
+    live &= 7;                                              \
+  }
+  
+  BZ_FLUSH_BYTES;
+  for (; i + 3 <= n; i += 3) {
+    BZ_PUT_CODE(mtfv[i]);
+    BZ_PUT_CODE(mtfv[i+1]);
+    BZ_PUT_CODE(mtfv[i+2]);
+    BZ_FLUSH_BYTES;
+  }
+  for (; i < n; i++) {
+    BZ_PUT_CODE(mtfv[i]);
+  }
+  
+#undef BZ_PUT_CODE
+#undef BZ_FLUSH_BYTES
+  
+  s->bsBuff = buff;
+  s->bsLive = live;
+  s->numZ   = (Int32)(z - s->zbits);
+}
+
+
 /*---------------------------------------------------*/
 static void bsPutUInt32 ( EState* s, UInt32 u ) {
    bsW ( s, 8, (u >> 24) & 0xffL );
@@ -96,6 +183,39 @@ static void makeMaps_e ( EState* s ) {
 }
 
 
+/*---------------------------------------------------*/
+#if defined(BZ_SIMD_SSE2) || defined(BZ_SIMD_NEON)
+/*--
+   Position of c in the MTF list, 16 entries per
+   compare.  c must be in the list; all 256 entries
+   are initialised, so no compare reads garbage.
+--*/
+static inline Int32 mtfFind ( const UChar* yy, UChar c ) {
+#if defined(BZ_SIMD_SSE2)
+  __m128i key = _mm_set1_epi8 ( (char)c );
+  for (Int32 j = 0; ; j += 16) {
+    UInt32 m = (UInt32)_mm_movemask_epi8 (
+                 _mm_cmpeq_epi8 ( _mm_loadu_si128 ( (const __m128i*)(yy + j) ), key ) );
+    if (m != 0) {
+      return j + __builtin_ctz ( m );
+    }
+  }
+#else
+  uint8x16_t key = vdupq_n_u8 ( c );
+  for (Int32 j = 0; ; j += 16) {
+    uint8x16_t eq = vceqq_u8 ( vld1q_u8 ( yy + j ), key );
+    /* 4 bits per lane, as NEON has no movemask */
+    uint64_t   m  = vget_lane_u64 ( vreinterpret_u64_u8 (
+                      vshrn_n_u16 ( vreinterpretq_u16_u8 ( eq ), 4 ) ), 0 );
+    if (m != 0) {
+      return j + (__builtin_ctzll ( m ) >> 2);
+    }
+  }
+#endif
+}
+#endif
+
+
 /*---------------------------------------------------*/
 static void generateMoveToFrontValues ( EState* s ) {
   UChar   yy[256];
@@ -128,6 +248,9 @@ static void generateMoveToFrontValues ( EState* s ) {
   UInt32* ptr   = s->ptr;
   UChar* block  = s->block;
   UInt16* mtfv  = s->mtfv;
+#if defined(BZ_SIMD_SSE2) || defined(BZ_SIMD_NEON)
+  Bool    simd  = (Bool)((BZ2_cpuFeatures () & BZ_CPU_SIMD) != 0);
+#endif
   
   makeMaps_e ( s );
   EOB = s->nInUse+1;
@@ -136,7 +259,7 @@ static void generateMoveToFrontValues ( EState* s ) {
     s->moveToFrontFreq[i] = 0;
   }
   
-  for (Int32 i = 0; i < s->nInUse; i++) {
+  for (Int32 i = 0; i < 256; i++) {
     yy[i] = (UChar) i;
   }
   
@@ -170,6 +293,23 @@ static void generateMoveToFrontValues ( EState* s ) {
         }
         zPend = 0;
       }
+#if defined(BZ_SIMD_SSE2) || defined(BZ_SIMD_NEON)
+      if (simd) {
+        Int32 j = mtfFind ( yy, ll_i );
+        /* short moves are cheaper inline than through memmove */
+        if (j < 16) {
+          for (Int32 k = j; k > 0; k--) {
+            yy[k] = yy[k-1];
+          }
+        }
+        else {
+          memmove ( &yy[1], &yy[0], j );
+        }
+        yy[0] = ll_i;
+        precedingIndexOfBurrowWheelerTransformation = j;
+      }
+      else
+#endif
       {
         UChar  rtmp;
         UChar* ryy_j;
@@ -187,10 +327,10 @@ static void generateMoveToFrontValues ( EState* s ) {
         };
         yy[0] = rtmp;
         precedingIndexOfBurrowWheelerTransformation = (int) (ryy_j - &(yy[0]));
-        mtfv[wr] = precedingIndexOfBurrowWheelerTransformation+1;
-        wr += 1;
-        s->moveToFrontFreq[precedingIndexOfBurrowWheelerTransformation+1] += 1;
       }
+      mtfv[wr] = precedingIndexOfBurrowWheelerTransformation+1;
+      wr += 1;
+      s->moveToFrontFreq[precedingIndexOfBurrowWheelerTransformation+1] += 1;
       
     }
   }
@@ -228,11 +368,63 @@ static void generateMoveToFrontValues ( EState* s ) {
 static const int BZ_LESSER_ICOST  = 0;
 static const int BZ_GREATER_ICOST = 15;
 
+#if defined(BZ_SIMD_SSE2) || defined(BZ_SIMD_NEON)
+/*--
+   Cost of one group under all coding tables at once.
+   s->len_pack[v] holds len[0..7][v] as 16-bit lanes, so
+   one vector add per symbol accumulates every table's
+   cost.  A group is at most BZ_G_SIZE symbols of length
+   <= 17, which keeps the sums well inside 16 bits.  Lanes
+   for unused tables start at 0x7fff so they never win.
+   Ties go to the lowest table number, as in the scalar loop.
+--*/
+static inline Int32 selectTable ( EState* s,
+                                  const UInt16* mtfv,
+                                  Int32 n,
+                                  Int32 nGroups,
+                                  Int32* bestCost ) {
+  UInt32 mn;
+  Int32  bt;
+#if defined(BZ_SIMD_SSE2)
+  __m128i lane = _mm_setr_epi16 ( 0, 1, 2, 3, 4, 5, 6, 7 );
+  __m128i acc  = _mm_srli_epi16 (
+                   _mm_cmpgt_epi16 ( lane, _mm_set1_epi16 ( (short)(nGroups-1) ) ),
+                   1 );
+  __m128i m;
+  for (Int32 i = 0; i < n; i++) {
+    acc = _mm_add_epi16 ( acc,
+                          _mm_loadu_si128 ( (const __m128i*)s->len_pack[mtfv[i]] ) );
+  }
+  m = _mm_min_epi16 ( acc, _mm_shuffle_epi32 ( acc, _MM_SHUFFLE(1,0,3,2) ) );
+  m = _mm_min_epi16 ( m,   _mm_shuffle_epi32 ( m,   _MM_SHUFFLE(2,3,0,1) ) );
+  m = _mm_min_epi16 ( m,   _mm_shufflelo_epi16 ( m, _MM_SHUFFLE(2,3,0,1) ) );
+  mn = (UInt32)_mm_cvtsi128_si32 ( m ) & 0xffff;
+  bt = __builtin_ctz ( (UInt32)_mm_movemask_epi8 (
+                         _mm_cmpeq_epi16 ( acc, _mm_set1_epi16 ( (short)mn ) ) ) ) >> 1;
+#else
+  static const UInt16 laneIdx[8] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+  uint16x8_t acc = vshrq_n_u16 (
+                     vcgtq_u16 ( vld1q_u16 ( laneIdx ), vdupq_n_u16 ( (UInt16)(nGroups-1) ) ),
+                     1 );
+  uint8x8_t  eq;
+  for (Int32 i = 0; i < n; i++) {
+    acc = vaddq_u16 ( acc, vld1q_u16 ( s->len_pack[mtfv[i]] ) );
+  }
+  mn = vminvq_u16 ( acc );
+  eq = vshrn_n_u16 ( vceqq_u16 ( acc, vdupq_n_u16 ( (UInt16)mn ) ), 4 );
+  bt = __builtin_ctzll ( vget_lane_u64 ( vreinterpret_u64_u8 ( eq ), 0 ) ) >> 3;
+#endif
+  *bestCost = (Int32)mn;
+  return bt;
+}
+#endif
+
 static void sendMoveToFrontValues ( EState* s ) {
   Int32 j;
   Int32 gs;
   Int32 ge;
   Int32 totc;
+  Int32 prevTotc;
   Int32 bt;
   Int32 bc;
   Int32 nSelectors = 0;
@@ -258,6 +450,9 @@ static void sendMoveToFrontValues ( EState* s ) {
   Int32  fave[BZ_N_GROUPS];
   
   UInt16* mtfv = s->mtfv;
+#if defined(BZ_SIMD_SSE2) || defined(BZ_SIMD_NEON)
+  Bool    simd = (Bool)((BZ2_cpuFeatures () & BZ_CPU_SIMD) != 0);
+#endif
   
   alphaSize = s->nInUse+2;
   for (Int32 t = 0; t < BZ_N_GROUPS; t++) {
@@ -332,8 +527,15 @@ static void sendMoveToFrontValues ( EState* s ) {
   
   /*---
    Iterate up to BZ_N_ITERS times to improve the tables.
+   Once a pass picks the same selectors as the one before,
+   it would rebuild the same tables, and so would every
+   later pass; stopping there leaves the output unchanged.
+   A non-zero s->tableTolerance also stops as soon as a
+   pass gains less than that many per mille of the cost.
    ---*/
+  prevTotc = 0;
   for (Int32 iter = 0; iter < BZ_N_ITERS; iter++) {
+    Bool changed = (Bool)(iter == 0);
     
     for (Int32 t = 0; t < nGroups; t++) {
       fave[t] = 0;
@@ -345,18 +547,21 @@ static void sendMoveToFrontValues ( EState* s ) {
       }
     }
     
+#if defined(BZ_SIMD_SSE2) || defined(BZ_SIMD_NEON)
     /*---
-     Set up an auxiliary length table which is used to fast-track
-     the common case (nGroups == 6).
+     Set up an auxiliary length table, transposed so that
+     the lengths of one symbol under all tables form one
+     vector; see selectTable.
      ---*/
-    if (nGroups == 6) {
+    if (simd) {
       for (Int32 v = 0; v < alphaSize; v++) {
-        s->len_pack[v][0] = (s->len[1][v] << 16) | s->len[0][v];
-        s->len_pack[v][1] = (s->len[3][v] << 16) | s->len[2][v];
-        s->len_pack[v][2] = (s->len[5][v] << 16) | s->len[4][v];
+        for (Int32 t = 0; t < 8; t++) {
+          s->len_pack[v][t] = t < nGroups ? s->len[t][v] : 0;
+        }
       }
     }
-    
+#endif
+
     nSelectors = 0;
     totc = 0;
     gs = 0;
@@ -375,30 +580,41 @@ static void sendMoveToFrontValues ( EState* s ) {
        Calculate the cost of this group as coded
        by each of the coding tables.
        --*/
-      for (Int32 t = 0; t < nGroups; t++) {
-        cost[t] = 0;
+#if defined(BZ_SIMD_SSE2) || defined(BZ_SIMD_NEON)
+      if (simd) {
+        bt = selectTable ( s, &mtfv[gs], ge - gs + 1, nGroups, &bc );
       }
-
-      for (Int32 i = gs; i <= ge; i++) {
-        UInt16 icv = mtfv[i];
+      else
+#endif
+      {
         for (Int32 t = 0; t < nGroups; t++) {
-          cost[t] += s->len[t][icv];
+          cost[t] = 0;
+        }
+
+        for (Int32 i = gs; i <= ge; i++) {
+          UInt16 icv = mtfv[i];
+          for (Int32 t = 0; t < nGroups; t++) {
+            cost[t] += s->len[t][icv];
+          }
         }
-      }
       
-      /*--
-       Find the coding table which is best for this group,
-       and record its identity in the selector table.
-       --*/
-      bc = 999999999; bt = -1;
-      for (Int32 t = 0; t < nGroups; t++) {
-        if (cost[t] < bc) {
-          bc = cost[t];
-          bt = t;
-        };
+        /*--
+         Find the coding table which is best for this group,
+         and record its identity in the selector table.
+         --*/
+        bc = 999999999; bt = -1;
+        for (Int32 t = 0; t < nGroups; t++) {
+          if (cost[t] < bc) {
+            bc = cost[t];
+            bt = t;
+          };
+        }
       }
       totc += bc;
       fave[bt] += 1;
+      if (s->selector[nSelectors] != bt) {
+        changed = True;
+      }
       s->selector[nSelectors] = bt;
       nSelectors += 1;
       
@@ -409,6 +625,10 @@ static void sendMoveToFrontValues ( EState* s ) {
       gs = ge+1;
     }
     
+    if (!changed) {
+      break;
+    }
+    
     /*--
      Recompute the tables based on the accumulated frequencies.
      --*/
@@ -417,6 +637,12 @@ static void sendMoveToFrontValues ( EState* s ) {
     for (Int32 t = 0; t < nGroups; t++) {
       BZ2_hbMakeCodeLengths ( &(s->len[t][0]), &(s->rfreq[t][0]), alphaSize, 17 /*20*/ );
     }
+    
+    if (iter > 0 && s->tableTolerance > 0
+        && prevTotc - totc < (prevTotc / 1000) * s->tableTolerance) {
+      break;
+    }
+    prevTotc = totc;
   }
   
     
@@ -533,9 +759,10 @@ static void sendMoveToFrontValues ( EState* s ) {
       ge = s->nMoveToFront-1;
     }
     
-    for (Int32 i = gs; i <= ge; i++) {
-      bsW ( s, s->len  [s->selector[selCtr]] [mtfv[i]], s->code [s->selector[selCtr]] [mtfv[i]] );
-    }
+    bsWGroup ( s,
+               &(s->len [s->selector[selCtr]][0]),
+               &(s->code[s->selector[selCtr]][0]),
+               &mtfv[gs], ge - gs + 1 );
     
     gs = ge+1;
     selCtr += 1;
@@ -543,6 +770,57 @@ static void sendMoveToFrontValues ( EState* s ) {
 }
 
 
+/*---------------------------------------------------*/
+static void writeStreamHeader ( EState* s ) {
+  bsPutUChar ( s, BZ_HDR_B );
+  bsPutUChar ( s, BZ_HDR_Z );
+  bsPutUChar ( s, BZ_HDR_h );
+  bsPutUChar ( s, (UChar)(BZ_HDR_0 + s->blockSize100k) );
+}
+
+
+/*---------------------------------------------------*/
+static void writeBlockBody ( EState* s ) {
+  bsPutUChar ( s, 0x31 );
+  bsPutUChar ( s, 0x41 );
+  bsPutUChar ( s, 0x59 );
+  bsPutUChar ( s, 0x26 );
+  bsPutUChar ( s, 0x53 );
+  bsPutUChar ( s, 0x59 );
+  
+  /*-- Now the block's CRC, so it is in a known place. --*/
+  bsPutUInt32 ( s, s->blockCRC );
+  
+  /*--
+   Now a single bit indicating (non-)randomisation.
+   As of version 0.9.5, we use a better sorting algorithm
+   which makes randomisation unnecessary.  So always set
+   the randomised bit to 'no'.  Of course, the decoder
+   still needs to be able to handle randomised blocks
+   so as to maintain backwards compatibility with
+   older versions of bzip2.
+   --*/
+  bsW (s, 1, 0);
+  
+  bsW ( s, 24, s->origPtr );
+  generateMoveToFrontValues ( s );
+  sendMoveToFrontValues ( s );
+}
+
+
+/*---------------------------------------------------*/
+static void writeStreamTrailer ( EState* s ) {
+  bsPutUChar ( s, 0x17 );
+  bsPutUChar ( s, 0x72 );
+  bsPutUChar ( s, 0x45 );
+  bsPutUChar ( s, 0x38 );
+  bsPutUChar ( s, 0x50 );
+  bsPutUChar ( s, 0x90 );
+  bsPutUInt32 ( s, s->combinedCRC );
+  bsFinishWrite ( s );
+}
+
+
 /*---------------------------------------------------*/
 // Diese Funktion wird nur durch handle_compress aufgerufen
 void BZ2_compressBlock ( EState* status, Bool is_last_block ) {
@@ -563,52 +841,115 @@ void BZ2_compressBlock ( EState* status, Bool is_last_block ) {
   /*-- If this is the first block, create the stream header. --*/
   if (status->blockNo == 1) {
     BZ2_bsInitWrite ( status );
-    bsPutUChar ( status, BZ_HDR_B );
-    bsPutUChar ( status, BZ_HDR_Z );
-    bsPutUChar ( status, BZ_HDR_h );
-    bsPutUChar ( status, (UChar)(BZ_HDR_0 + status->blockSize100k) );
+    writeStreamHeader ( status );
   }
   
   if (status->nblock > 0) {
-    bsPutUChar ( status, 0x31 );
-    bsPutUChar ( status, 0x41 );
-    bsPutUChar ( status, 0x59 );
-    bsPutUChar ( status, 0x26 );
-    bsPutUChar ( status, 0x53 );
-    bsPutUChar ( status, 0x59 );
-    
-    /*-- Now the block's CRC, so it is in a known place. --*/
-    bsPutUInt32 ( status, status->blockCRC );
-    
-    /*--
-     Now a single bit indicating (non-)randomisation.
-     As of version 0.9.5, we use a better sorting algorithm
-     which makes randomisation unnecessary.  So always set
-     the randomised bit to 'no'.  Of course, the decoder
-     still needs to be able to handle randomised blocks
-     so as to maintain backwards compatibility with
-     older versions of bzip2.
-     --*/
-    bsW (status, 1, 0);
-    
-    bsW ( status, 24, status->origPtr );
-    generateMoveToFrontValues ( status );
-    sendMoveToFrontValues ( status );
+    writeBlockBody ( status );
   }
   
   /*-- If this is the last block, add the stream trailer. --*/
   if (is_last_block) {
-    bsPutUChar ( status, 0x17 );
-    bsPutUChar ( status, 0x72 );
-    bsPutUChar ( status, 0x45 );
-    bsPutUChar ( status, 0x38 );
-    bsPutUChar ( status, 0x50 );
-    bsPutUChar ( status, 0x90 );
-    bsPutUInt32 ( status, status->combinedCRC );
-    bsFinishWrite ( status );
+    writeStreamTrailer ( status );
   }
 }
 
+
+/*---------------------------------------------------*/
+/*--- Separately compressed blocks                ---*/
+/*---------------------------------------------------*/
+
+/*--
+   Ein Block hängt im Bitstrom nur über seine Bitposition
+   vom Vorgänger ab. Er kann daher unabhängig ab Bit 0
+   komprimiert und später bitgenau an den laufenden Strom
+   angehängt werden; das Ergebnis ist identisch zur
+   sequentiellen Kompression.
+--*/
+
+/*---------------------------------------------------*/
+/**
+ * @brief Komprimiert den Block in `s` ohne Stream-Kopf und -Ende.
+ *
+ * Der Block-CRC muss bereits finalisiert sein. Die Ausgabe beginnt
+ * bei Bit 0 in `s->zbits`, das letzte Byte ist mit Nullbits aufgefüllt.
+ *
+ * @return Länge des komprimierten Blocks in Bits.
+ */
+Int32 BZ2_compressBlockBits ( EState* s ) {
+  s->numZ = 0;
+  BZ2_blockSort ( s );
+  s->zbits = (UChar*) (&((UChar*)s->arr2)[s->nblock]);
+  BZ2_bsInitWrite ( s );
+  writeBlockBody ( s );
+  bsFinishWrite ( s );
+  /* bsFinishWrite laesst bsLive im Bereich -7 .. 0 zurueck */
+  return 8 * s->numZ + s->bsLive;
+}
+
+
+/*---------------------------------------------------*/
+static void bsFlushWholeBytes ( EState* s ) {
+  while (s->bsLive >= 8) {
+    s->zbits[s->numZ] = (UChar)(s->bsBuff >> 56);
+    s->numZ += 1;
+    s->bsBuff <<= 8;
+    s->bsLive -= 8;
+  }
+}
+
+
+/*---------------------------------------------------*/
+/* Schreibt den Stream-Kopf ab s->zbits[s->numZ]; danach gilt bsLive < 8. */
+void BZ2_compressStreamHeader ( EState* s ) {
+  writeStreamHeader ( s );
+  bsFlushWholeBytes ( s );
+}
+
+
+/*---------------------------------------------------*/
+/* Schreibt das Stream-Ende inklusive der noch offenen Bits aus bsBuff. */
+void BZ2_compressStreamTrailer ( EState* s ) {
+  writeStreamTrailer ( s );
+}
+
+
+/*---------------------------------------------------*/
+/**
+ * @brief Hängt einen separat komprimierten Block an den Bitstrom an.
+ *
+ * Die höchstens 7 noch offenen Bits in `s->bsBuff` werden vorangestellt,
+ * `z` wird dazu an Ort und Stelle um `s->bsLive` Bits verschoben. Danach
+ * zeigt `s->zbits` auf die vollständigen Bytes in `z`; die Bits des
+ * letzten, unvollständigen Bytes verbleiben in `s->bsBuff`.
+ *
+ * @param s     Kompressionszustand mit `bsLive < 8`.
+ * @param z     Ausgabe von `BZ2_compressBlockBits`.
+ * @param nBits deren Länge in Bits.
+ */
+void BZ2_bsSpliceBlock ( EState* s, UChar* z, Int32 nBits ) {
+  Int32 shift  = s->bsLive;
+  Int32 nBytes = (nBits + 7) / 8;
+  Int32 total  = shift + nBits;
+  UChar carry  = (UChar)(s->bsBuff >> 56);
+  UChar last;
+  
+  if (shift > 0) {
+    for (Int32 i = 0; i < nBytes; i++) {
+      UChar b = z[i];
+      z[i]  = carry | (UChar)(b >> shift);
+      carry = (UChar)(b << (8 - shift));
+    }
+  }
+  
+  s->zbits         = z;
+  s->numZ          = total / 8;
+  s->state_out_pos = 0;
+  s->bsLive        = total % 8;
+  last = (s->numZ < nBytes) ? z[s->numZ] : carry;
+  s->bsBuff = (s->bsLive > 0) ? ((UInt64)(last & (0xff << (8 - s->bsLive))) << 56) : 0;
+}
+
 /*-------------------------------------------------------------*/
 /*--- end                                        compress.c ---*/
 /*-------------------------------------------------------------*/
@@ -0,0 +1,75 @@
+
+/*-------------------------------------------------------------*/
+/*--- CPU feature detection for the SIMD kernels            ---*/
+/*---                                                 cpu.c ---*/
+/*-------------------------------------------------------------*/
+
+/* ------------------------------------------------------------------
+   This file is part of bzip2/libbzip2, a program and library for
+   lossless, block-sorting data compression.
+
+   bzip2/libbzip2 version 1.1.0 of 6 September 2010
+   Copyright (C) 1996-2010 Julian Seward <jseward@acm.org>
+
+   Please read the WARNING, DISCLAIMER and PATENTS sections in the
+   README file.
+
+   This program is released under the terms of the license contained
+   in the file COPYING.
+   ------------------------------------------------------------------ */
+
+#include <pthread.h>
+
+#include "bzlib_private.h"
+
+
+static UInt32         cpuFeatures = 0;
+static pthread_once_t cpuOnce     = PTHREAD_ONCE_INIT;
+
+
+/*---------------------------------------------------*/
+/**
+ * @brief Ermittelt einmalig die nutzbaren Befehlssatzerweiterungen.
+ *
+ * Auf x86-64 fragt `__builtin_cpu_supports` die CPU über `cpuid` ab,
+ * SSE2 gehört dort zur Grundausstattung. Auf ARM ist NEON zur
+ * Übersetzungszeit festgelegt. Ist die Umgebungsvariable
+ * `BZIP2_SCALAR` gesetzt und nicht `0`, bleiben alle Merkmale aus
+ * und jeder Kernel nimmt seinen skalaren Pfad.
+ */
+static void cpu_detect ( void ) {
+  UInt32      f   = 0;
+  const char* env = getenv ( "BZIP2_SCALAR" );
+
+  if (env != NULL && env[0] != '\0' && strcmp ( env, "0" ) != 0) {
+    cpuFeatures = 0;
+    return;
+  }
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+  __builtin_cpu_init ();
+  f |= BZ_CPU_SIMD;
+  if (__builtin_cpu_supports ( "pclmul" ) && __builtin_cpu_supports ( "ssse3" )) {
+    f |= BZ_CPU_CLMUL;
+  }
+#elif defined(__SSE2__) || defined(__ARM_NEON)
+  f |= BZ_CPU_SIMD;
+#endif
+  cpuFeatures = f;
+}
+
+
+/*---------------------------------------------------*/
+/**
+ * @brief Liefert die Merkmale `BZ_CPU_*`, die die Kernel nutzen dürfen.
+ *
+ * Die Erkennung läuft beim ersten Aufruf genau einmal, auch wenn
+ * mehrere Threads gleichzeitig fragen.
+ */
+UInt32 BZ2_cpuFeatures ( void ) {
+  pthread_once ( &cpuOnce, cpu_detect );
+  return cpuFeatures;
+}
+
+/*-------------------------------------------------------------*/
+/*--- end                                             cpu.c ---*/
+/*-------------------------------------------------------------*/
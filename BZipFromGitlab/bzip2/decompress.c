@@ -44,7 +44,7 @@ static void makeMaps_d ( DState* s ) {
    while (True) {                                 \
       if (s->bsLive >= nnn) {                     \
          UInt32 v;                                \
-         v = (s->bsBuff >>                        \
+         v = (UInt32)(s->bsBuff >>                \
              (s->bsLive-nnn)) & ((1 << nnn)-1);   \
          s->bsLive -= nnn;                        \
          vvv = v;                                 \
@@ -53,14 +53,11 @@ static void makeMaps_d ( DState* s ) {
       if (s->strm->avail_in == 0) RETURN(BZ_OK);  \
       s->bsBuff                                   \
          = (s->bsBuff << 8) |                     \
-           ((UInt32)                              \
+           ((UInt64)                              \
               (*((UChar*)(s->strm->next_in))));   \
       s->bsLive += 8;                             \
-      s->strm->next_in += 1;                         \
-      s->strm->avail_in -= 1;                        \
-      s->strm->total_in_lo32 += 1;                   \
-      if (s->strm->total_in_lo32 == 0)            \
-         s->strm->total_in_hi32 -= 1;                \
+      s->strm->next_in += 1;                      \
+      s->strm->avail_in -= 1;                     \
    }
 
 #define GET_UCHAR(lll,uuu)                        \
@@ -70,6 +67,56 @@ static void makeMaps_d ( DState* s ) {
    GET_BITS(lll,uuu,1)
 
 /*---------------------------------------------------*/
+/*--
+   Tops the bit buffer up to at least 56 bits, as far
+   as input is available, with one word load when 8
+   bytes are there.  Only used while decoding MTF values
+   and only with bsLive < 56: every symbol is followed by
+   at least an end-of-block code plus the 80 bits of the
+   next block header or the stream trailer, so the bytes
+   taken in advance never reach past the end of the stream.
+--*/
+#define REFILL_BITS                               \
+   if (s->strm->avail_in >= 8) {                  \
+      Int32 nb = (63 - s->bsLive) >> 3;           \
+      s->bsBuff                                   \
+         = (s->bsBuff << (8 * nb)) |              \
+           (loadBE64 ( (UChar*)s->strm->next_in ) \
+              >> (64 - 8 * nb));                  \
+      s->bsLive += 8 * nb;                        \
+      s->strm->next_in += nb;                     \
+      s->strm->avail_in -= nb;                    \
+   }                                              \
+   else {                                         \
+      while (s->bsLive <= 56                      \
+             && s->strm->avail_in > 0) {          \
+         s->bsBuff                                \
+            = (s->bsBuff << 8) |                  \
+              ((UInt64)                           \
+                 (*((UChar*)(s->strm->next_in))));\
+         s->bsLive += 8;                          \
+         s->strm->next_in += 1;                   \
+         s->strm->avail_in -= 1;                  \
+      }                                           \
+   }
+
+#define SET_GROUP_TABLES                          \
+{                                                 \
+   gSel = s->selector[groupNo];                   \
+   gMinlen = s->minLens[gSel];                    \
+   gLimit = &(s->limit[gSel][0]);                 \
+   gPerm = &(s->perm[gSel][0]);                   \
+   gBase = &(s->base[gSel][0]);                   \
+   gLookup = &(s->lookup[gSel][0]);               \
+}
+
+/*--
+   Codes of up to BZ_HUFF_LOOKUP_BITS bits are decoded
+   with one lookup.  Longer codes, and the end of the
+   available input, take the resumable bit-at-a-time
+   path; the case labels in the else branch are where
+   a suspended call comes back in.
+--*/
 #define GET_MTF_VAL(label1,label2,lval)           \
 {                                                 \
    if (groupPos == 0) {                           \
@@ -77,13 +124,23 @@ static void makeMaps_d ( DState* s ) {
       if (groupNo >= nSelectors)                  \
          RETURN(BZ_DATA_ERROR);                   \
       groupPos = BZ_G_SIZE;                       \
-      gSel = s->selector[groupNo];                \
-      gMinlen = s->minLens[gSel];                 \
-      gLimit = &(s->limit[gSel][0]);              \
-      gPerm = &(s->perm[gSel][0]);                \
-      gBase = &(s->base[gSel][0]);                \
+      SET_GROUP_TABLES;                           \
    }                                              \
    groupPos -= 1;                                    \
+   if (s->bsLive < BZ_HUFF_LOOKUP_BITS) {         \
+      REFILL_BITS;                                \
+   }                                              \
+   zj = 0;                                        \
+   if (s->bsLive >= BZ_HUFF_LOOKUP_BITS) {        \
+      zj = gLookup[(s->bsBuff >>                  \
+                    (s->bsLive-BZ_HUFF_LOOKUP_BITS)) \
+                   & (BZ_HUFF_LOOKUP_SIZE-1)];    \
+   }                                              \
+   if (zj != 0) {                                 \
+      s->bsLive -= zj >> 9;                       \
+      lval = zj & 511;                            \
+   }                                              \
+   else {                                         \
    zn = gMinlen;                                  \
    GET_BITS(label1, zvec, zn);                    \
    while (1) {                                    \
@@ -98,6 +155,340 @@ static void makeMaps_d ( DState* s ) {
        || zvec - gBase[zn] >= BZ_MAX_ALPHA_SIZE)  \
       RETURN(BZ_DATA_ERROR);                      \
    lval = gPerm[zvec - gBase[zn]];                \
+   }                                              \
+}
+
+
+/*---------------------------------------------------*/
+/*--
+   Reads the next MTF value at a symbol boundary.  With
+   enough input at hand the non-suspending decoder runs
+   first; whatever it leaves, at the end of the input,
+   is read by the resumable path.
+--*/
+#define GET_NEXT_MTF_VAL(label1,label2)           \
+{                                                 \
+   fastRet = BZ_OK;                               \
+   if (s->strm->avail_in >= BZ_FAST_MIN_INPUT) {  \
+      fastRet = decodeMTFFast ( s, EOB,           \
+                   nSelectors, nblockMAX,         \
+                   &nblock, &groupNo, &groupPos ); \
+      if (fastRet == BZ_DATA_ERROR)               \
+         RETURN(BZ_DATA_ERROR);                   \
+      if (groupNo >= 0)                           \
+         SET_GROUP_TABLES;                        \
+   }                                              \
+   if (fastRet == BZ_STREAM_END) {                \
+      nextSym = EOB;                              \
+   }                                              \
+   else {                                         \
+   GET_MTF_VAL(label1, label2, nextSym);          \
+   }                                              \
+}
+
+
+/*---------------------------------------------------*/
+/*--
+   uc = MTF ( nn ), moving the symbol to the front.
+--*/
+static inline UChar mtfDecode ( DState* s, UInt32 nn ) {
+  Int32 ii; Int32 jj; Int32 kk; Int32 pp; Int32 lno; Int32 off;
+  UChar uc;
+  
+  if (nn < MOVE_TO_FRONT_L_SIZE) {
+    /* avoid general-case expense */
+    pp = s->moveToFrontBase[0];
+    uc = s->moveToFront_a[pp+nn];
+    while (nn > 3) {
+      Int32 z = pp+nn;
+      s->moveToFront_a[(z)  ] = s->moveToFront_a[(z)-1];
+      s->moveToFront_a[(z)-1] = s->moveToFront_a[(z)-2];
+      s->moveToFront_a[(z)-2] = s->moveToFront_a[(z)-3];
+      s->moveToFront_a[(z)-3] = s->moveToFront_a[(z)-4];
+      nn -= 4;
+    }
+    while (nn > 0) {
+      s->moveToFront_a[(pp+nn)] = s->moveToFront_a[(pp+nn)-1];
+      nn -= 1;
+    }
+    s->moveToFront_a[pp] = uc;
+  } else {
+    /* general case */
+    lno = nn / MOVE_TO_FRONT_L_SIZE;
+    off = nn % MOVE_TO_FRONT_L_SIZE;
+    pp = s->moveToFrontBase[lno] + off;
+    uc = s->moveToFront_a[pp];
+    while (pp > s->moveToFrontBase[lno]) {
+      s->moveToFront_a[pp] = s->moveToFront_a[pp-1];
+      pp -= 1;
+    };
+    s->moveToFrontBase[lno] += 1;
+    while (lno > 0) {
+      s->moveToFrontBase[lno] -= 1;
+      s->moveToFront_a[s->moveToFrontBase[lno]]
+      = s->moveToFront_a[s->moveToFrontBase[lno-1] + MOVE_TO_FRONT_L_SIZE - 1];
+      lno -= 1;
+    }
+    s->moveToFrontBase[0] -= 1;
+    s->moveToFront_a[s->moveToFrontBase[0]] = uc;
+    if (s->moveToFrontBase[0] == 0) {
+      kk = MOVE_TO_FRONT_A_SIZE-1;
+      for (ii = 256 / MOVE_TO_FRONT_L_SIZE-1; ii >= 0; ii--) {
+        for (jj = MOVE_TO_FRONT_L_SIZE-1; jj >= 0; jj--) {
+          s->moveToFront_a[kk] = s->moveToFront_a[s->moveToFrontBase[ii] + jj];
+          kk -= 1;
+        }
+        s->moveToFrontBase[ii] = kk + 1;
+      }
+    }
+  }
+  return uc;
+}
+
+
+/*---------------------------------------------------*/
+/*--
+   Non-suspending decoder for the MTF values of a
+   block, for callers which hand over a large part of
+   the compressed data at once.  Bit buffer and input
+   pointer are kept in locals and every symbol is read
+   without asking whether input remains; instead, each
+   item (a literal or a whole RUNA/RUNB run) starts
+   with a checkpoint, and if an item cannot be read
+   completely from the input at hand, everything is
+   rolled back to that checkpoint.  The caller then
+   continues with the resumable path, which reads the
+   same item again.  The item is only written to the
+   block once it is complete, so a rollback never has
+   to undo anything.
+
+   Returns BZ_STREAM_END when the end-of-block symbol
+   was read, BZ_OK when the resumable path has to go
+   on, and BZ_DATA_ERROR in exactly the cases where
+   the resumable path would report it.
+--*/
+static Int32 decodeMTFFast ( DState* s, Int32 EOB, Int32 nSelectors, Int32 nblockMAX,
+                             Int32* pNblock, Int32* pGroupNo, Int32* pGroupPos ) {
+  bz_stream*   strm     = s->strm;
+  const UChar* in       = (const UChar*)strm->next_in;
+  const UChar* inEnd    = in + strm->avail_in;
+  UInt64       bsBuff   = s->bsBuff;
+  Int32        bsLive   = s->bsLive;
+  Int32        nblock   = *pNblock;
+  Int32        groupNo  = *pGroupNo;
+  Int32        groupPos = *pGroupPos;
+  Int32        retVal   = BZ_OK;
+  Int32        gSel;
+  Int32        gMinlen  = 0;
+  Int32*       gLimit   = NULL;
+  Int32*       gBase    = NULL;
+  Int32*       gPerm    = NULL;
+  UInt16*      gLookup  = NULL;
+  
+  /* the checkpoint at the start of the current item */
+  const UChar* cpIn;
+  UInt64       cpBsBuff;
+  Int32        cpBsLive;
+  Int32        cpGroupNo;
+  Int32        cpGroupPos;
+  
+  Int32        sym;
+  Int32        zn;
+  Int32        zvec;
+  Int32        es;
+  Int32        N;
+  UInt32       e;
+  UChar        uc;
+  UInt32       consumed;
+  
+  if (groupNo >= 0) {
+    SET_GROUP_TABLES;
+  }
+  
+/*-- Reads one symbol into sym; jumps to rollback when
+     the input runs short and to data_error as
+     GET_MTF_VAL would. --*/
+#define FAST_MTF_VAL                                            \
+  {                                                             \
+    if (bsLive < BZ_MAX_CODE_LEN) {                             \
+      if (inEnd - in >= 8) {                                    \
+        Int32 nb = (63 - bsLive) >> 3;                          \
+        bsBuff = (bsBuff << (8 * nb))                           \
+                 | (loadBE64 ( in ) >> (64 - 8 * nb));          \
+        bsLive += 8 * nb;                                       \
+        in += nb;                                               \
+      }                                                         \
+      while (bsLive <= 56 && in < inEnd) {                      \
+        bsBuff = (bsBuff << 8) | (UInt64)(*in);                 \
+        bsLive += 8;                                            \
+        in += 1;                                                \
+      }                                                         \
+      if (bsLive < BZ_MAX_CODE_LEN) {                           \
+        goto rollback;                                          \
+      }                                                         \
+    }                                                           \
+    if (groupPos == 0) {                                        \
+      groupNo += 1;                                             \
+      if (groupNo >= nSelectors) {                              \
+        goto data_error;                                        \
+      }                                                         \
+      groupPos = BZ_G_SIZE;                                     \
+      SET_GROUP_TABLES;                                         \
+    }                                                           \
+    groupPos -= 1;                                              \
+    e = gLookup[(bsBuff >> (bsLive - BZ_HUFF_LOOKUP_BITS))      \
+                & (BZ_HUFF_LOOKUP_SIZE-1)];                     \
+    if (e != 0) {                                               \
+      bsLive -= e >> 9;                                         \
+      sym = e & 511;                                            \
+    }                                                           \
+    else {                                                      \
+      zn = gMinlen;                                             \
+      while (True) {                                            \
+        if (zn > 20 /* the longest code */) {                   \
+          goto data_error;                                      \
+        }                                                       \
+        zvec = (Int32)(bsBuff >> (bsLive - zn)) & ((1 << zn) - 1); \
+        if (zvec <= gLimit[zn]) {                               \
+          break;                                                \
+        }                                                       \
+        zn += 1;                                                \
+      }                                                         \
+      if (zvec - gBase[zn] < 0                                  \
+          || zvec - gBase[zn] >= BZ_MAX_ALPHA_SIZE) {           \
+        goto data_error;                                        \
+      }                                                         \
+      bsLive -= zn;                                             \
+      sym = gPerm[zvec - gBase[zn]];                            \
+    }                                                           \
+  }
+  
+  while (True) {
+    cpIn       = in;
+    cpBsBuff   = bsBuff;
+    cpBsLive   = bsLive;
+    cpGroupNo  = groupNo;
+    cpGroupPos = groupPos;
+    
+    FAST_MTF_VAL;
+    
+    if (sym == BZ_RUNA || sym == BZ_RUNB) {
+      es = -1;
+      N = 1;
+      do {
+        /* see BZ2_decompress */
+        if (N >= 2*1024*1024) {
+          goto data_error;
+        }
+        es = es + (sym+1) * N;
+        N = N * 2;
+        FAST_MTF_VAL;
+      }
+      while (sym == BZ_RUNA || sym == BZ_RUNB);
+      
+      es += 1;
+      uc = s->seqToUnseq[ s->moveToFront_a[s->moveToFrontBase[0]] ];
+      if (es > nblockMAX - nblock) {
+        goto data_error;
+      }
+      s->unzftab[uc] += es;
+      if (s->smallDecompress) {
+        while (es > 0) {
+          s->ll16[nblock] = (UInt16)uc;
+          nblock += 1;
+          es -= 1;
+        }
+      }
+      else {
+        while (es > 0) {
+          s->tt[nblock] = (UInt32)uc;
+          nblock += 1;
+          es -= 1;
+        }
+      }
+    }
+    
+    /*-- sym is now a literal or EOB, read either as
+         the first symbol of the item or as the one
+         ending the run. --*/
+    if (sym == EOB) {
+      retVal = BZ_STREAM_END;
+      break;
+    }
+    if (nblock >= nblockMAX) {
+      goto data_error;
+    }
+    uc = mtfDecode ( s, (UInt32)(sym - 1) );
+    s->unzftab[s->seqToUnseq[uc]] += 1;
+    if (s->smallDecompress) {
+      s->ll16[nblock] = (UInt16)(s->seqToUnseq[uc]);
+    }
+    else {
+      s->tt[nblock]   = (UInt32)(s->seqToUnseq[uc]);
+    }
+    nblock += 1;
+  }
+  goto save_and_return;
+  
+data_error:
+  retVal = BZ_DATA_ERROR;
+  goto save_and_return;
+  
+rollback:
+  in       = cpIn;
+  bsBuff   = cpBsBuff;
+  bsLive   = cpBsLive;
+  groupNo  = cpGroupNo;
+  groupPos = cpGroupPos;
+  
+save_and_return:
+  consumed = (UInt32)(in - (const UChar*)strm->next_in);
+  strm->next_in        = (char*)in;
+  strm->avail_in      -= consumed;
+  s->bsBuff  = bsBuff;
+  s->bsLive  = bsLive;
+  *pNblock   = nblock;
+  *pGroupNo  = groupNo;
+  *pGroupPos = groupPos;
+  return retVal;
+  
+#undef FAST_MTF_VAL
+}
+
+
+/*---------------------------------------------------*/
+/*--
+   T^(-1) is a single cycle through origPtr.  Byte k
+   of the block lies k+1 steps forward from origPtr,
+   byte nblock-1-k lies k steps backward from it.  The
+   two directions are walked at once, so two chains of
+   cache misses overlap instead of one being waited
+   for byte by byte.  The unRLE pass then reads the
+   block sequentially from bwtBlock.
+--*/
+static void undoBWTTwoWalkers ( DState* s, Int32 nblock )
+{
+   UInt32* tt   = s->tt;
+   UInt32* lf   = s->lf;
+   UChar*  out  = s->bwtBlock;
+   Int32   half = nblock / 2;
+   UInt32  p    = tt[s->origPtr] >> 8;
+   UInt32  q    = (UInt32)s->origPtr;
+   Int32   i, j;
+
+   for (i = 0, j = nblock - 1; i < half; i++, j--) {
+      UInt32 a = tt[p];
+      UInt32 b = lf[q];
+      out[i] = (UChar)(a & 0xff);
+      out[j] = (UChar)(b & 0xff);
+      p = a >> 8;
+      q = b >> 8;
+   }
+   if (nblock & 1) {
+      out[half] = (UChar)(tt[p] & 0xff);
+   }
+   /* the cycle continues with byte 0 */
+   out[nblock] = out[0];
 }
 
 
@@ -134,6 +525,14 @@ Int32 BZ2_decompress ( DState* s )
   Int32* gLimit;
   Int32* gBase;
   Int32* gPerm;
+  UInt16* gLookup;
+  
+  /* not saved: only set and tested in GET_NEXT_MTF_VAL */
+  Int32  fastRet;
+  
+  /* total_in is brought up to date once, on the way out */
+  char*  inStart = strm->next_in;
+  UInt32 consumed;
   
   if (s->state == BZ_X_MAGIC_1) {
     /*initialise the save area*/
@@ -161,6 +560,7 @@ Int32 BZ2_decompress ( DState* s )
     s->save_gLimit      = NULL;
     s->save_gBase       = NULL;
     s->save_gPerm       = NULL;
+    s->save_gLookup     = NULL;
   }
   
   /*restore from the save area*/
@@ -188,6 +588,7 @@ Int32 BZ2_decompress ( DState* s )
   gLimit      = s->save_gLimit;
   gBase       = s->save_gBase;
   gPerm       = s->save_gPerm;
+  gLookup     = s->save_gLookup;
   
   retVal = BZ_OK;
   
@@ -215,16 +616,33 @@ Int32 BZ2_decompress ( DState* s )
       }
       s->blockSize100k -= BZ_HDR_0;
       
+      /*-- Buffers left by BZ2_bzDecompressReset are reused
+           when the block size matches. --*/
+      if (s->ttBlockSize100k != s->blockSize100k) {
+        if (s->tt   != NULL) BZFREE(s->tt);
+        if (s->ll16 != NULL) BZFREE(s->ll16);
+        if (s->ll4  != NULL) BZFREE(s->ll4);
+        s->tt   = NULL;
+        s->ll16 = NULL;
+        s->ll4  = NULL;
+      }
       if (s->smallDecompress) {
-        s->ll16 = BZALLOC( s->blockSize100k * 100000 * sizeof(UInt16) );
-        s->ll4  = BZALLOC(
-                          ((1 + s->blockSize100k * 100000) >> 1) * sizeof(UChar)
-                          );
+        if (s->ll16 == NULL) {
+          s->ll16 = BZALLOC( s->blockSize100k * 100000 * sizeof(UInt16) );
+        }
+        if (s->ll4 == NULL) {
+          s->ll4  = BZALLOC(
+                            ((1 + s->blockSize100k * 100000) >> 1) * sizeof(UChar)
+                            );
+        }
         if (s->ll16 == NULL || s->ll4 == NULL) RETURN(BZ_MEM_ERROR);
       } else {
-        s->tt  = BZALLOC( s->blockSize100k * 100000 * sizeof(Int32) );
+        if (s->tt == NULL) {
+          s->tt  = BZALLOC( s->blockSize100k * 100000 * sizeof(Int32) );
+        }
         if (s->tt == NULL) RETURN(BZ_MEM_ERROR);
       }
+      s->ttBlockSize100k = s->blockSize100k;
       
       GET_UCHAR(BZ_X_BLKHDR_1, uc);
       
@@ -405,6 +823,13 @@ Int32 BZ2_decompress ( DState* s )
                                   maxLen,
                                   alphaSize
                                   );
+        BZ2_hbCreateLookupTable (
+                                 &(s->lookup[t][0]),
+                                 &(s->limit[t][0]),
+                                 &(s->base[t][0]),
+                                 &(s->perm[t][0]),
+                                 minLen
+                                 );
         s->minLens[t] = minLen;
       }
       
@@ -436,7 +861,7 @@ Int32 BZ2_decompress ( DState* s )
       /*-- end MTF init --*/
       
       nblock = 0;
-      GET_MTF_VAL(BZ_X_MTF_1, BZ_X_MTF_2, nextSym);
+      GET_NEXT_MTF_VAL(BZ_X_MTF_1, BZ_X_MTF_2);
       
       while (True) {
         
@@ -502,61 +927,7 @@ Int32 BZ2_decompress ( DState* s )
             RETURN(BZ_DATA_ERROR);
           }
           
-          /*-- uc = MTF ( nextSym-1 ) --*/
-          {
-            Int32 ii; Int32 jj; Int32 kk; Int32 pp; Int32 lno; Int32 off;
-            UInt32 nn;
-            nn = (UInt32)(nextSym - 1);
-            
-            if (nn < MOVE_TO_FRONT_L_SIZE) {
-              /* avoid general-case expense */
-              pp = s->moveToFrontBase[0];
-              uc = s->moveToFront_a[pp+nn];
-              while (nn > 3) {
-                Int32 z = pp+nn;
-                s->moveToFront_a[(z)  ] = s->moveToFront_a[(z)-1];
-                s->moveToFront_a[(z)-1] = s->moveToFront_a[(z)-2];
-                s->moveToFront_a[(z)-2] = s->moveToFront_a[(z)-3];
-                s->moveToFront_a[(z)-3] = s->moveToFront_a[(z)-4];
-                nn -= 4;
-              }
-              while (nn > 0) {
-                s->moveToFront_a[(pp+nn)] = s->moveToFront_a[(pp+nn)-1];
-                nn -= 1;
-              }
-              s->moveToFront_a[pp] = uc;
-            } else {
-              /* general case */
-              lno = nn / MOVE_TO_FRONT_L_SIZE;
-              off = nn % MOVE_TO_FRONT_L_SIZE;
-              pp = s->moveToFrontBase[lno] + off;
-              uc = s->moveToFront_a[pp];
-              while (pp > s->moveToFrontBase[lno]) {
-                s->moveToFront_a[pp] = s->moveToFront_a[pp-1];
-                pp -= 1;
-              };
-              s->moveToFrontBase[lno] += 1;
-              while (lno > 0) {
-                s->moveToFrontBase[lno] -= 1;
-                s->moveToFront_a[s->moveToFrontBase[lno]]
-                = s->moveToFront_a[s->moveToFrontBase[lno-1] + MOVE_TO_FRONT_L_SIZE - 1];
-                lno -= 1;
-              }
-              s->moveToFrontBase[0] -= 1;
-              s->moveToFront_a[s->moveToFrontBase[0]] = uc;
-              if (s->moveToFrontBase[0] == 0) {
-                kk = MOVE_TO_FRONT_A_SIZE-1;
-                for (ii = 256 / MOVE_TO_FRONT_L_SIZE-1; ii >= 0; ii--) {
-                  for (jj = MOVE_TO_FRONT_L_SIZE-1; jj >= 0; jj--) {
-                    s->moveToFront_a[kk] = s->moveToFront_a[s->moveToFrontBase[ii] + jj];
-                    kk -= 1;
-                  }
-                  s->moveToFrontBase[ii] = kk + 1;
-                }
-              }
-            }
-          }
-          /*-- end uc = MTF ( nextSym-1 ) --*/
+          uc = mtfDecode ( s, (UInt32)(nextSym - 1) );
           
           s->unzftab[s->seqToUnseq[uc]] += 1;
           if (s->smallDecompress) {
@@ -567,7 +938,7 @@ Int32 BZ2_decompress ( DState* s )
           }
           nblock += 1;
           
-          GET_MTF_VAL(BZ_X_MTF_5, BZ_X_MTF_6, nextSym);
+          GET_NEXT_MTF_VAL(BZ_X_MTF_5, BZ_X_MTF_6);
           continue;
         }
       }
@@ -615,6 +986,8 @@ Int32 BZ2_decompress ( DState* s )
       
       if (s->smallDecompress) {
         
+        s->bwtDecoded = False;
+        
         /*-- Make a copy of cftab, used in generation of T --*/
         for (i = 0; i <= 256; i++) {
           s->cftabCopy[i] = s->cftab[i];
@@ -654,6 +1027,47 @@ Int32 BZ2_decompress ( DState* s )
         
       } else {
         
+        if (!s->blockRandomised && nblock >= BZ_IBWT_MIN_BLOCK
+            && (s->lf == NULL || s->bwtBlockSize100k != s->blockSize100k)) {
+          if (s->lf != NULL) {
+            BZFREE(s->lf);
+          }
+          if (s->bwtBlock != NULL) {
+            BZFREE(s->bwtBlock);
+          }
+          s->lf       = BZALLOC( s->blockSize100k * 100000 * sizeof(UInt32) );
+          s->bwtBlock = BZALLOC( s->blockSize100k * 100000 + 1 );
+          s->bwtBlockSize100k = s->blockSize100k;
+          /* without them the single chain below still works */
+          if (s->lf == NULL || s->bwtBlock == NULL) {
+            if (s->lf != NULL) {
+              BZFREE(s->lf);
+            }
+            if (s->bwtBlock != NULL) {
+              BZFREE(s->bwtBlock);
+            }
+            s->lf       = NULL;
+            s->bwtBlock = NULL;
+          }
+        }
+        s->bwtDecoded = (Bool)(!s->blockRandomised && nblock >= BZ_IBWT_MIN_BLOCK
+                               && s->lf != NULL);
+        
+        if (s->bwtDecoded) {
+          /*-- compute T^(-1) and its inverse, then walk both --*/
+          for (i = 0; i < nblock; i++) {
+            uc = (UChar)(s->tt[i] & 0xff);
+            s->lf[i] = ((UInt32)s->cftab[uc] << 8) | uc;
+            s->tt[s->cftab[uc]] |= (i << 8);
+            s->cftab[uc] += 1;
+          }
+          undoBWTTwoWalkers ( s, nblock );
+          s->nblock_used = 0;
+          s->k0 = s->bwtBlock[0];
+          s->nblock_used += 1;
+          RETURN(BZ_OK);
+        }
+        
         /*-- compute the T^(-1) vector --*/
         for (i = 0; i < nblock; i++) {
           uc = (UChar)(s->tt[i] & 0xff);
@@ -720,6 +1134,12 @@ Int32 BZ2_decompress ( DState* s )
   
 save_state_and_return:
   
+  consumed = (UInt32)(strm->next_in - inStart);
+  strm->total_in_lo32 += consumed;
+  if (strm->total_in_lo32 < consumed) {
+    strm->total_in_hi32 += 1;
+  }
+  
   s->save_i           = i;
   s->save_j           = j;
   s->save_t           = t;
@@ -744,6 +1164,7 @@ save_state_and_return:
   s->save_gLimit      = gLimit;
   s->save_gBase       = gBase;
   s->save_gPerm       = gPerm;
+  s->save_gLookup     = gLookup;
   
   return retVal;
 }
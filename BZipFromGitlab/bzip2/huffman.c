@@ -239,6 +239,41 @@ void BZ2_hbCreateDecodeTables ( Int32 *limit, Int32 *base, Int32 *perm, UChar *l
 }
 
 
+/*---------------------------------------------------*/
+/*--
+   Builds the one-step lookup table for the codes of
+   at most BZ_HUFF_LOOKUP_BITS bits.  Each entry is
+   what the bit-at-a-time search over limit/base/perm
+   yields for that bit pattern, so both ways of
+   decoding agree even for malformed code lengths.
+   Patterns which need more bits, or for which the
+   search ends in an error, get 0 and are left to the
+   search.
+--*/
+void BZ2_hbCreateLookupTable ( UInt16 *lookup, Int32 *limit, Int32 *base, Int32 *perm, Int32 minLen ) {
+  Int32 v;
+  Int32 zn;
+  Int32 zvec;
+  Int32 sym;
+  
+  for (v = 0; v < BZ_HUFF_LOOKUP_SIZE; v++) {
+    lookup[v] = 0;
+    for (zn = minLen; zn <= BZ_HUFF_LOOKUP_BITS; zn++) {
+      zvec = v >> (BZ_HUFF_LOOKUP_BITS - zn);
+      if (zvec <= limit[zn]) {
+        if (zvec - base[zn] >= 0 && zvec - base[zn] < BZ_MAX_ALPHA_SIZE) {
+          sym = perm[zvec - base[zn]];
+          if (sym >= 0 && sym < 512) {
+            lookup[v] = (UInt16)((zn << 9) | sym);
+          }
+        }
+        break;
+      }
+    }
+  }
+}
+
+
 /*-------------------------------------------------------------*/
 /*--- end                                         huffman.c ---*/
 /*-------------------------------------------------------------*/
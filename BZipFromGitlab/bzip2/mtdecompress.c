@@ -0,0 +1,449 @@
+
+/*-------------------------------------------------------------*/
+/*--- Block-parallel decompression                          ---*/
+/*---                                        mtdecompress.c ---*/
+/*-------------------------------------------------------------*/
+
+/* ------------------------------------------------------------------
+   This file is part of bzip2/libbzip2, a program and library for
+   lossless, block-sorting data compression.
+
+   bzip2/libbzip2 version 1.1.0 of 6 September 2010
+   Copyright (C) 1996-2010 Julian Seward <jseward@acm.org>
+
+   Please read the WARNING, DISCLAIMER and PATENTS sections in the
+   README file.
+
+   This program is released under the terms of the license contained
+   in the file COPYING.
+   ------------------------------------------------------------------ */
+
+/*--
+   Blöcke beginnen an beliebigen Bitpositionen, sind aber nach
+   ihrer 48 Bit langen Magic (0x314159265359) unabhängig
+   dekodierbar. Die Eingabe wird daher bitweise nach dieser
+   Magic durchsucht und jeder Fundort spekulativ auf einem
+   Arbeits-Thread dekodiert.
+
+   Der aufrufende Thread folgt der echten Blockkette: er beginnt
+   hinter dem Stream-Kopf und springt jeweils an das Bitende des
+   zuletzt angenommenen Blocks. Liegt dort ein fertig dekodierter
+   Kandidat, wird dessen Ausgabe übernommen; Fehlalarme mitten in
+   komprimierten Daten werden nie erreicht und verworfen. Fehlt
+   ein passendes Ergebnis oder ist es fehlerhaft, wird der Block
+   dort im aufrufenden Thread dekodiert. Da erst geprüfte Blöcke
+   ausgegeben werden, kann der erste gemeldete Fehler dennoch ein
+   anderer sein als beim sequentiellen Dekodieren; die Aufrufer
+   wiederholen deshalb im Fehlerfall sequentiell.
+--*/
+
+#include "bzlib_private.h"
+
+
+static const Int32  BZ_MT_SCAN_CHUNK = 1 << 20;
+
+
+/*---------------------------------------------------*/
+static void job_decode ( void* arg ) {
+  MTDecodeJob* job = (MTDecodeJob*)arg;
+  bz_stream*   strm = &job->strm;
+  UInt64       byte = job->startBit / 8;
+  Int32        r;
+
+  job->outLen = 0;
+  strm->next_in  = (char*)(job->src + byte);
+  strm->avail_in = (job->srcLen - byte > 0xffffffffULL) ? 0xffffffffU : (unsigned int)(job->srcLen - byte);
+  r = BZ2_decompressEnterBlock ( strm, job->blockSize100k, (Int32)(job->startBit % 8) );
+
+  while (r == BZ_OK) {
+    if (job->outLen == job->outCap) {
+      UInt32 cap = (job->outCap == 0) ? (UInt32)(100000 * job->blockSize100k + 1024) : 2 * job->outCap;
+      UChar* out = realloc ( job->out, cap );
+      if (out == NULL) {
+        r = BZ_MEM_ERROR;
+        break;
+      }
+      job->out    = out;
+      job->outCap = cap;
+    }
+    strm->next_out  = (char*)(job->out + job->outLen);
+    strm->avail_out = job->outCap - job->outLen;
+    r = BZ2_bzDecompress ( strm );
+    job->outLen = job->outCap - strm->avail_out;
+    if (r == BZ_OK && strm->avail_out > 0) {
+      /* Eingabe zu Ende, Block aber nicht */
+      r = BZ_UNEXPECTED_EOF;
+    }
+  }
+
+  if (r == BZ_STREAM_END) {
+    DState* s = strm->state;
+    job->ret      = BZ_OK;
+    job->endBit   = 8 * (UInt64)((UChar*)strm->next_in - job->src) - s->bsLive;
+    job->blockCRC = s->storedBlockCRC;
+    job->nblock   = s->save_nblock;
+  }
+  else {
+    job->ret = r;
+  }
+}
+
+
+/*---------------------------------------------------*/
+static Int32 job_init ( MTDecodeJob* job, MTDecoder* d ) {
+  job->task.run = job_decode;
+  job->task.arg = job;
+  job->task.done = True;
+  job->src    = d->src;
+  job->srcLen = d->srcLen;
+  job->out    = NULL;
+  job->outLen = 0;
+  job->outCap = 0;
+  job->strm.bzalloc = NULL;
+  job->strm.bzfree  = NULL;
+  job->strm.opaque  = NULL;
+  return BZ2_bzDecompressInit ( &job->strm, d->small );
+}
+
+
+/*---------------------------------------------------*/
+static void job_free ( MTDecodeJob* job ) {
+  if (job->strm.state != NULL) {
+    BZ2_bzDecompressEnd ( &job->strm );
+  }
+  free ( job->out );
+}
+
+
+/*---------------------------------------------------*/
+static UInt64 peek_bits ( MTDecoder* d, UInt64 bitPos, Int32 n ) {
+  UInt64 v = 0;
+  for (Int32 i = 0; i < n; i++) {
+    UInt64 p = bitPos + i;
+    v = (v << 1) | ((d->src[p / 8] >> (7 - p % 8)) & 1);
+  }
+  return v;
+}
+
+
+/*---------------------------------------------------*/
+/* Sucht den nächsten Abschnitt der Eingabe nach Block-Magics ab. */
+static Int32 scan_more ( MTDecoder* d ) {
+  UInt64 end = d->scanByte + BZ_MT_SCAN_CHUNK;
+  UInt64 w   = d->scanWindow;
+
+  if (end > d->srcLen) {
+    end = d->srcLen;
+  }
+  for (UInt64 i = d->scanByte; i < end; i++) {
+    w = (w << 8) | d->src[i];
+    if (i < 6) {
+      continue;
+    }
+    /* Die Magic kann an jeder der 8 Bitpositionen enden. */
+    for (Int32 k = 7; k >= 0; k--) {
+      if (((w >> k) & 0xffffffffffffULL) == BZ_BLOCK_MAGIC) {
+        if (d->nCand == d->capCand) {
+          Int32   cap  = (d->capCand == 0) ? 256 : 2 * d->capCand;
+          UInt64* cand = realloc ( d->cand, cap * sizeof(UInt64) );
+          if (cand == NULL) {
+            return BZ_MEM_ERROR;
+          }
+          d->cand    = cand;
+          d->capCand = cap;
+        }
+        d->cand[d->nCand] = 8 * (i + 1) - k - 48;
+        d->nCand += 1;
+      }
+    }
+  }
+  d->scanByte   = end;
+  d->scanWindow = w;
+  return BZ_OK;
+}
+
+
+/*---------------------------------------------------*/
+/* Füllt freie Aufträge mit weiteren Kandidaten hinter der Kettenposition. */
+static Int32 submit_candidates ( MTDecoder* d ) {
+  while (d->count < d->nJobs) {
+    MTDecodeJob* job;
+    while (d->nextCand < d->nCand && d->cand[d->nextCand] < d->pos) {
+      d->nextCand += 1;
+    }
+    if (d->nextCand == d->nCand) {
+      if (d->scanByte >= d->srcLen) {
+        break;
+      }
+      if (scan_more ( d ) != BZ_OK) {
+        return BZ_MEM_ERROR;
+      }
+      continue;
+    }
+    job = &d->jobs[(d->head + d->count) % d->nJobs];
+    job->startBit      = d->cand[d->nextCand];
+    job->blockSize100k = d->blockSize100k;
+    d->nextCand += 1;
+    BZ2_poolSubmit ( d->pool, &job->task );
+    d->count += 1;
+  }
+  return BZ_OK;
+}
+
+
+/*---------------------------------------------------*/
+static void retire_head ( MTDecoder* d ) {
+  BZ2_poolWait ( d->pool, &d->jobs[d->head].task );
+  d->head = (d->head + 1) % d->nJobs;
+  d->count -= 1;
+}
+
+
+/*---------------------------------------------------*/
+/* Fehlalarme vor der Kettenposition verwerfen. */
+static void retire_stale ( MTDecoder* d ) {
+  while (d->count > 0 && d->jobs[d->head].startBit < d->pos) {
+    retire_head ( d );
+  }
+}
+
+
+/*---------------------------------------------------*/
+/**
+ * @brief Liefert den dekodierten Block, der bei `d->pos` beginnt.
+ *
+ * Bevorzugt wird das spekulative Ergebnis eines Arbeits-Threads,
+ * sonst wird im aufrufenden Thread dekodiert.
+ */
+static MTDecodeJob* block_at_pos ( MTDecoder* d ) {
+  MTDecodeJob* job;
+
+  if (d->count > 0 && d->jobs[d->head].startBit == d->pos) {
+    job = &d->jobs[d->head];
+    BZ2_poolWait ( d->pool, &job->task );
+    if (job->ret == BZ_OK
+        && job->blockSize100k == d->blockSize100k) {
+      return job;
+    }
+    /* z.B. Blockgröße eines Folgestreams falsch geraten */
+  }
+  job = &d->self;
+  job->startBit      = d->pos;
+  job->blockSize100k = d->blockSize100k;
+  job_decode ( job );
+  return job;
+}
+
+
+/*---------------------------------------------------*/
+static Int32 decode_stream ( MTDecoder* d ) {
+  UInt64 srcBits = 8 * d->srcLen;
+  UInt32 combinedCRC = 0;
+  const UChar* h;
+
+  /*-- Stream-Kopf, immer byteweise ausgerichtet --*/
+  h = d->src + d->pos / 8;
+  for (UInt64 i = 0; i < 4; i++) {
+    if (d->pos / 8 + i >= d->srcLen) {
+      return BZ_UNEXPECTED_EOF;
+    }
+    if ((i == 0 && h[0] != BZ_HDR_B) || (i == 1 && h[1] != BZ_HDR_Z) || (i == 2 && h[2] != BZ_HDR_h)
+        || (i == 3 && (h[3] < BZ_HDR_0 + 1 || h[3] > BZ_HDR_0 + 9))) {
+      return BZ_DATA_ERROR_MAGIC;
+    }
+  }
+  d->blockSize100k = h[3] - BZ_HDR_0;
+  d->pos += 32;
+
+  while (True) {
+    UInt64 magic;
+    MTDecodeJob* job;
+    Int32 r;
+
+    if (d->pos + 48 > srcBits) {
+      return BZ_UNEXPECTED_EOF;
+    }
+    magic = peek_bits ( d, d->pos, 48 );
+
+    if (magic == BZ_EOS_MAGIC) {
+      if (d->pos + 80 > srcBits) {
+        return BZ_UNEXPECTED_EOF;
+      }
+      if ((UInt32)peek_bits ( d, d->pos + 48, 32 ) != combinedCRC) {
+        return BZ_DATA_ERROR;
+      }
+      d->pos = ((d->pos + 80 + 7) / 8) * 8;
+      return BZ_STREAM_END;
+    }
+    if (magic != BZ_BLOCK_MAGIC) {
+      return BZ_DATA_ERROR;
+    }
+
+    retire_stale ( d );
+    r = submit_candidates ( d );
+    if (r != BZ_OK) {
+      return r;
+    }
+    job = block_at_pos ( d );
+    if (job->ret != BZ_OK) {
+      return job->ret;
+    }
+    combinedCRC = (combinedCRC << 1) | (combinedCRC >> 31);
+    combinedCRC ^= job->blockCRC;
+    if (job->outLen > 0) {
+      r = d->sink ( d->opaque, job->out, job->outLen );
+      if (r != BZ_OK) {
+        return r;
+      }
+    }
+    d->pos = job->endBit;
+  }
+}
+
+
+/*---------------------------------------------------*/
+/**
+ * @brief Dekomprimiert einen vollständig im Speicher liegenden
+ * .bz2-Strom mit bis zu `nThreads` Arbeits-Threads.
+ *
+ * Die Ausgabe wird in Reihenfolge an `sink` übergeben; ein anderes
+ * Ergebnis als `BZ_OK` von `sink` bricht ab und wird zurückgegeben.
+ * Ohne `allStreams` endet die Dekodierung nach dem ersten Stream,
+ * dahinter stehende Bytes werden ignoriert. Mit `allStreams` werden
+ * wie von bzip2 hintereinander gehängte Streams bis zum Ende der
+ * Eingabe dekodiert; Fremddaten hinter dem letzten Stream ergeben
+ * wie dort `BZ_DATA_ERROR_MAGIC` mit `*streamNo` größer 1.
+ *
+ * @param streamNo Anzahl der begonnenen Streams (darf NULL sein).
+ * @return `BZ_OK` oder ein Fehlercode wie von `BZ2_bzDecompress`.
+ */
+Int32 BZ2_decompressMT ( const UChar* src, UInt64 srcLen, Int32 small, Int32 nThreads, Bool allStreams,
+                         BZ2_mtSink sink, void* opaque, Int32* streamNo ) {
+  MTDecoder d;
+  Int32     r;
+  Int32     nStreams = 0;
+
+  if (src == NULL || sink == NULL || (small != 0 && small != 1)
+      || nThreads < 1 || nThreads > BZ_MAX_THREADS) {
+    return BZ_PARAM_ERROR;
+  }
+  memset ( &d, 0, sizeof(d) );
+  d.src    = src;
+  d.srcLen = srcLen;
+  d.small  = small;
+  d.sink   = sink;
+  d.opaque = opaque;
+  d.nJobs  = 2 * nThreads;
+
+  r = BZ_MEM_ERROR;
+  d.jobs = calloc ( d.nJobs, sizeof(MTDecodeJob) );
+  if (d.jobs == NULL) {
+    goto cleanup;
+  }
+  for (Int32 i = 0; i < d.nJobs; i++) {
+    if (job_init ( &d.jobs[i], &d ) != BZ_OK) {
+      goto cleanup;
+    }
+  }
+  if (job_init ( &d.self, &d ) != BZ_OK) {
+    goto cleanup;
+  }
+  d.pool = BZ2_poolCreate ( nThreads );
+  if (d.pool == NULL) {
+    goto cleanup;
+  }
+
+  while (True) {
+    nStreams += 1;
+    r = decode_stream ( &d );
+    if (r == BZ_STREAM_END) {
+      if (allStreams && d.pos / 8 < srcLen) {
+        continue;
+      }
+      r = BZ_OK;
+    }
+    break;
+  }
+
+ cleanup:
+  if (streamNo != NULL) {
+    *streamNo = nStreams;
+  }
+  if (d.pool != NULL) {
+    while (d.count > 0) {
+      retire_head ( &d );
+    }
+    BZ2_poolDestroy ( d.pool );
+  }
+  if (d.jobs != NULL) {
+    for (Int32 i = 0; i < d.nJobs; i++) {
+      job_free ( &d.jobs[i] );
+    }
+    free ( d.jobs );
+  }
+  job_free ( &d.self );
+  free ( d.cand );
+  return r;
+}
+
+
+/*---------------------------------------------------*/
+typedef struct {
+  char*        dest;
+  unsigned int destLen;
+  unsigned int used;
+}
+BuffSink;
+
+static Int32 buff_sink ( void* opaque, const UChar* buf, UInt32 len ) {
+  BuffSink* b = (BuffSink*)opaque;
+  if (len > b->destLen - b->used) {
+    return BZ_OUTBUFF_FULL;
+  }
+  memcpy ( b->dest + b->used, buf, len );
+  b->used += len;
+  return BZ_OK;
+}
+
+
+/*---------------------------------------------------*/
+/**
+ * @brief Wie `BZ2_bzBuffToBuffDecompress`, dekodiert die Blöcke aber
+ * mit bis zu `nThreads` Arbeits-Threads.
+ *
+ * Ein Block wird erst nach der CRC-Prüfung in `dest` kopiert. Bei
+ * beschädigter Eingabe kann der parallele Pfad daher einen anderen
+ * Fehler zuerst sehen als der sequentielle, der z.B. schon an einem
+ * zu kleinen `dest` scheitert. Schlägt er fehl, wird die Eingabe
+ * darum sequentiell dekodiert und deren Ergebnis zurückgegeben, so
+ * dass Rückgabewert und `*destLen` immer denen von
+ * `BZ2_bzBuffToBuffDecompress` entsprechen.
+ */
+int BZ2_bzBuffToBuffDecompressMT ( char* dest, unsigned int* destLen, char* source, unsigned int sourceLen,
+                                   int small, int nThreads ) {
+  BuffSink b;
+  Int32    r;
+
+  if (dest == NULL || destLen == NULL || source == NULL
+      || (small != 0 && small != 1) || nThreads < 0 || nThreads > BZ_MAX_THREADS) {
+    return BZ_PARAM_ERROR;
+  }
+  if (nThreads <= 1) {
+    return BZ2_bzBuffToBuffDecompress ( dest, destLen, source, sourceLen, small );
+  }
+  b.dest    = dest;
+  b.destLen = *destLen;
+  b.used    = 0;
+  r = BZ2_decompressMT ( (UChar*)source, sourceLen, small, nThreads, False, buff_sink, &b, NULL );
+  if (r != BZ_OK) {
+    /* Fehler so melden, wie es der sequentielle Pfad täte */
+    return BZ2_bzBuffToBuffDecompress ( dest, destLen, source, sourceLen, small );
+  }
+  *destLen = b.used;
+  return BZ_OK;
+}
+
+
+/*-------------------------------------------------------------*/
+/*--- end                                    mtdecompress.c ---*/
+/*-------------------------------------------------------------*/
@@ -0,0 +1,179 @@
+
+/*-------------------------------------------------------------*/
+/*--- Worker thread pool                                    ---*/
+/*---                                          threadpool.c ---*/
+/*-------------------------------------------------------------*/
+
+/* ------------------------------------------------------------------
+   This file is part of bzip2/libbzip2, a program and library for
+   lossless, block-sorting data compression.
+
+   bzip2/libbzip2 version 1.1.0 of 6 September 2010
+   Copyright (C) 1996-2010 Julian Seward <jseward@acm.org>
+
+   Please read the WARNING, DISCLAIMER and PATENTS sections in the
+   README file.
+
+   This program is released under the terms of the license contained
+   in the file COPYING.
+   ------------------------------------------------------------------ */
+
+#include <pthread.h>
+
+#include "bzlib_private.h"
+
+
+/**
+ * @brief Ein einfacher Pool von Arbeits-Threads.
+ *
+ * Aufgaben (`bzPoolTask`) werden vom Aufrufer verwaltet und in eine
+ * FIFO-Warteschlange eingereiht. Jeder Thread entnimmt die älteste
+ * Aufgabe, führt sie aus und markiert sie als erledigt. Auf das Ende
+ * einer bestimmten Aufgabe kann mit `BZ2_poolWait` gewartet werden.
+ */
+struct bzPool {
+  pthread_mutex_t lock;
+  pthread_cond_t  workReady;
+  pthread_cond_t  workDone;
+  bzPoolTask*     first;
+  bzPoolTask*     last;
+  Bool            shutdown;
+  Int32           nThreads;
+  pthread_t       threads[BZ_MAX_THREADS];
+};
+
+
+/*---------------------------------------------------*/
+static void* poolWorker ( void* arg ) {
+  bzPool* pool = (bzPool*)arg;
+  bzPoolTask* task;
+
+  pthread_mutex_lock ( &pool->lock );
+  while (True) {
+    while (pool->first == NULL && !pool->shutdown) {
+      pthread_cond_wait ( &pool->workReady, &pool->lock );
+    }
+    if (pool->first == NULL) {
+      break;
+    }
+    task = pool->first;
+    pool->first = task->next;
+    if (pool->first == NULL) {
+      pool->last = NULL;
+    }
+    pthread_mutex_unlock ( &pool->lock );
+
+    task->run ( task->arg );
+
+    pthread_mutex_lock ( &pool->lock );
+    task->done = True;
+    pthread_cond_broadcast ( &pool->workDone );
+  }
+  pthread_mutex_unlock ( &pool->lock );
+  return NULL;
+}
+
+
+/*---------------------------------------------------*/
+bzPool* BZ2_poolCreate ( Int32 nThreads ) {
+  bzPool* pool;
+
+  if (nThreads < 1 || nThreads > BZ_MAX_THREADS) {
+    return NULL;
+  }
+  pool = malloc ( sizeof(bzPool) );
+  if (pool == NULL) {
+    return NULL;
+  }
+  pool->first    = NULL;
+  pool->last     = NULL;
+  pool->shutdown = False;
+  pool->nThreads = 0;
+  if (pthread_mutex_init ( &pool->lock, NULL ) != 0) {
+    free ( pool );
+    return NULL;
+  }
+  pthread_cond_init ( &pool->workReady, NULL );
+  pthread_cond_init ( &pool->workDone, NULL );
+
+  /* Weniger Threads als gewünscht sind kein Fehler, keiner schon. */
+  while (pool->nThreads < nThreads) {
+    if (pthread_create ( &pool->threads[pool->nThreads], NULL, poolWorker, pool ) != 0) {
+      break;
+    }
+    pool->nThreads += 1;
+  }
+  if (pool->nThreads == 0) {
+    BZ2_poolDestroy ( pool );
+    return NULL;
+  }
+  return pool;
+}
+
+
+/*---------------------------------------------------*/
+void BZ2_poolDestroy ( bzPool* pool ) {
+  if (pool == NULL) {
+    return;
+  }
+  pthread_mutex_lock ( &pool->lock );
+  pool->shutdown = True;
+  pthread_cond_broadcast ( &pool->workReady );
+  pthread_mutex_unlock ( &pool->lock );
+
+  for (Int32 i = 0; i < pool->nThreads; i++) {
+    pthread_join ( pool->threads[i], NULL );
+  }
+  pthread_cond_destroy ( &pool->workDone );
+  pthread_cond_destroy ( &pool->workReady );
+  pthread_mutex_destroy ( &pool->lock );
+  free ( pool );
+}
+
+
+/*---------------------------------------------------*/
+Int32 BZ2_poolSize ( bzPool* pool ) {
+  return pool->nThreads;
+}
+
+
+/*---------------------------------------------------*/
+void BZ2_poolSubmit ( bzPool* pool, bzPoolTask* task ) {
+  task->done = False;
+  task->next = NULL;
+  pthread_mutex_lock ( &pool->lock );
+  if (pool->last == NULL) {
+    pool->first = task;
+  }
+  else {
+    pool->last->next = task;
+  }
+  pool->last = task;
+  pthread_cond_signal ( &pool->workReady );
+  pthread_mutex_unlock ( &pool->lock );
+}
+
+
+/*---------------------------------------------------*/
+Bool BZ2_poolIsDone ( bzPool* pool, bzPoolTask* task ) {
+  Bool done;
+  pthread_mutex_lock ( &pool->lock );
+  done = task->done;
+  pthread_mutex_unlock ( &pool->lock );
+  return done;
+}
+
+
+/*---------------------------------------------------*/
+void BZ2_poolWait ( bzPool* pool, bzPoolTask* task ) {
+  pthread_mutex_lock ( &pool->lock );
+  while (!task->done) {
+    pthread_cond_wait ( &pool->workDone, &pool->lock );
+  }
+  pthread_mutex_unlock ( &pool->lock );
+}
+
+
+/*-------------------------------------------------------------*/
+/*--- end                                      threadpool.c ---*/
+/*-------------------------------------------------------------*/
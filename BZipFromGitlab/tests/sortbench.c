@@ -0,0 +1,248 @@
+
+/* Measures the block sorting algorithms.  Usage is
+       sortbench filename [reps]
+   The file is compressed reps times (default 5) with each of
+   BZ_SORT_AUTO, BZ_SORT_MAIN and BZ_SORT_SAIS, and once more with
+   BZ_SORT_MAIN in BZ_LAYOUT_PACKED; the best wall time is printed,
+   and on Linux also the cache misses of that run, read through
+   perf_event_open.  Where the counters are not available (other
+   systems, most virtual machines, perf_event_paranoid too high)
+   they are printed as n/a.  All runs must produce the same
+   compressed stream; the program checks that.
+*/
+
+/* ------------------------------------------------------------------
+   This file is part of bzip2/libbzip2, a program and library for
+   lossless, block-sorting data compression.
+
+   bzip2/libbzip2 version 1.1.0 of 6 September 2010
+   Copyright (C) 1996-2010 Julian Seward <jseward@acm.org>
+
+   Please read the WARNING, DISCLAIMER and PATENTS sections in the
+   README file.
+
+   This program is released under the terms of the license contained
+   in the file COPYING.
+   ------------------------------------------------------------------ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bzlib.h"
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#define N_COUNTERS 2
+#define N_SORTS    4
+
+static const char* counterNames[N_COUNTERS] = {
+   "cache-misses", "L1d-read-misses"
+};
+
+static const char* sortNames[N_SORTS] = { "auto", "main", "packed", "sais" };
+
+typedef struct {
+   int fd[N_COUNTERS];
+} Counters;
+
+
+/*---------------------------------------------*/
+#ifdef __linux__
+static int openCounter ( unsigned int type, unsigned long long config )
+{
+   struct perf_event_attr attr;
+
+   memset ( &attr, 0, sizeof(attr) );
+   attr.size           = sizeof(attr);
+   attr.type           = type;
+   attr.config         = config;
+   attr.disabled       = 1;
+   attr.exclude_kernel = 1;
+   attr.exclude_hv     = 1;
+   return (int)syscall ( SYS_perf_event_open, &attr, 0, -1, -1, 0 );
+}
+#endif
+
+static void countersOpen ( Counters* c )
+{
+   int i;
+   for (i = 0; i < N_COUNTERS; i++) c->fd[i] = -1;
+#ifdef __linux__
+   c->fd[0] = openCounter ( PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES );
+   c->fd[1] = openCounter ( PERF_TYPE_HW_CACHE,
+                            PERF_COUNT_HW_CACHE_L1D
+                            | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                            | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) );
+#endif
+}
+
+static void countersStart ( Counters* c )
+{
+#ifdef __linux__
+   int i;
+   for (i = 0; i < N_COUNTERS; i++) {
+      if (c->fd[i] < 0) continue;
+      ioctl ( c->fd[i], PERF_EVENT_IOC_RESET, 0 );
+      ioctl ( c->fd[i], PERF_EVENT_IOC_ENABLE, 0 );
+   }
+#endif
+}
+
+static void countersStop ( Counters* c, long long* values )
+{
+   int i;
+   for (i = 0; i < N_COUNTERS; i++) {
+      values[i] = -1;
+#ifdef __linux__
+      if (c->fd[i] < 0) continue;
+      ioctl ( c->fd[i], PERF_EVENT_IOC_DISABLE, 0 );
+      if (read ( c->fd[i], &values[i], sizeof(values[i]) ) != sizeof(values[i]))
+         values[i] = -1;
+#endif
+   }
+}
+
+static void countersClose ( Counters* c )
+{
+#ifdef __linux__
+   int i;
+   for (i = 0; i < N_COUNTERS; i++)
+      if (c->fd[i] >= 0) close ( c->fd[i] );
+#endif
+}
+
+
+/*---------------------------------------------*/
+static double now ( void )
+{
+   struct timespec t;
+   clock_gettime ( CLOCK_MONOTONIC, &t );
+   return t.tv_sec * 1000.0 + t.tv_nsec / 1000000.0;
+}
+
+static unsigned int compress ( char* src, unsigned int n,
+                               char* dst, unsigned int cap,
+                               int sort, int layout )
+{
+   bz_stream    strm;
+   unsigned int len;
+
+   memset ( &strm, 0, sizeof(strm) );
+   if (BZ2_bzCompressInit ( &strm, 9, 0 ) != BZ_OK ||
+       BZ2_bzCompressSetOption ( &strm, BZ_OPT_SORT_ALGORITHM, sort ) != BZ_OK ||
+       BZ2_bzCompressSetOption ( &strm, BZ_OPT_SORT_LAYOUT, layout ) != BZ_OK) {
+      fprintf ( stderr, "sortbench: cannot set up the compressor\n" );
+      exit ( 1 );
+   }
+   strm.next_in   = src;
+   strm.avail_in  = n;
+   strm.next_out  = dst;
+   strm.avail_out = cap;
+   if (BZ2_bzCompress ( &strm, BZ_FINISH ) != BZ_STREAM_END) {
+      fprintf ( stderr, "sortbench: compression failed\n" );
+      exit ( 1 );
+   }
+   len = cap - strm.avail_out;
+   BZ2_bzCompressEnd ( &strm );
+   return len;
+}
+
+
+/*---------------------------------------------*/
+int main ( int argc, char** argv )
+{
+   FILE*        f;
+   char*        in;
+   char*        out[N_SORTS];
+   unsigned int nIn, cap, nOut[N_SORTS];
+   int          sorts[N_SORTS] = { BZ_SORT_AUTO, BZ_SORT_MAIN,
+                                   BZ_SORT_MAIN, BZ_SORT_SAIS };
+   int          layouts[N_SORTS] = { BZ_LAYOUT_SPLIT, BZ_LAYOUT_SPLIT,
+                                     BZ_LAYOUT_PACKED, BZ_LAYOUT_SPLIT };
+   int          reps, k, r, i;
+   long         size;
+   Counters     c;
+
+   if (argc < 2) {
+      fprintf ( stderr, "usage: sortbench filename [reps]\n" );
+      return 1;
+   }
+   reps = (argc > 2) ? atoi ( argv[2] ) : 5;
+   if (reps < 1) reps = 1;
+
+   f = fopen ( argv[1], "rb" );
+   if (f == NULL) {
+      perror ( argv[1] );
+      return 1;
+   }
+   fseek ( f, 0, SEEK_END );
+   size = ftell ( f );
+   rewind ( f );
+   in = malloc ( size + 1 );
+   if (in == NULL) {
+      fprintf ( stderr, "sortbench: out of memory\n" );
+      return 1;
+   }
+   nIn = (unsigned int)fread ( in, 1, size, f );
+   fclose ( f );
+
+   cap = nIn + nIn / 100 + 600;
+   for (k = 0; k < N_SORTS; k++) {
+      out[k] = malloc ( cap );
+      if (out[k] == NULL) {
+         fprintf ( stderr, "sortbench: out of memory\n" );
+         return 1;
+      }
+   }
+
+   countersOpen ( &c );
+   printf ( "%s, %u bytes, best of %d\n", argv[1], nIn, reps );
+   for (k = 0; k < N_SORTS; k++) {
+      double    best = 0.0;
+      long long bestCounts[N_COUNTERS];
+
+      for (r = 0; r < reps; r++) {
+         double    t0, t;
+         long long counts[N_COUNTERS];
+
+         t0 = now ();
+         countersStart ( &c );
+         nOut[k] = compress ( in, nIn, out[k], cap,
+                              sorts[k], layouts[k] );
+         countersStop ( &c, counts );
+         t = now () - t0;
+         if (r == 0 || t < best) {
+            best = t;
+            memcpy ( bestCounts, counts, sizeof(counts) );
+         }
+      }
+
+      printf ( "  %-6s %9.1f ms", sortNames[k], best );
+      for (i = 0; i < N_COUNTERS; i++) {
+         if (bestCounts[i] < 0)
+            printf ( "  %s n/a", counterNames[i] );
+         else
+            printf ( "  %s %lld", counterNames[i], bestCounts[i] );
+      }
+      printf ( "\n" );
+   }
+   countersClose ( &c );
+
+   for (k = 1; k < N_SORTS; k++) {
+      if (nOut[k] != nOut[0] || memcmp ( out[k], out[0], nOut[0] ) != 0) {
+         fprintf ( stderr, "sortbench: %s and %s produced different streams\n",
+                   sortNames[k], sortNames[0] );
+         return 1;
+      }
+   }
+   free ( in );
+   for (k = 0; k < N_SORTS; k++) free ( out[k] );
+   return 0;
+}